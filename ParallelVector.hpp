@@ -10,10 +10,34 @@
 #include <string>
 #include <exception>
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <deque>
+#include <initializer_list>
+#include <utility>
+#include <limits>
+#include <random>
+#include <cmath>
+#include <bitset>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
 
 namespace PV {
 	typedef size_t size_type;
 	
+	// where Vector data lives: a regular cl::Buffer or fine-grained shared virtual memory
+	enum storage_mode {buffer_storage, svm_storage};
+	
 	enum operation {
 		plus,
 		minus,
@@ -72,6 +96,16 @@ namespace PV {
 	enum reduce_operation {reduce_plus, reduce_times, num_reduce_ops};
 	const char* const reduce_op_to_str[] = {"+=", "*="};
 	
+	// aggregates computed by PV::aggregate (combined with |) and by the segmented reductions
+	enum aggregate_kind {
+		aggregate_sum = 1,
+		aggregate_count = 2,
+		aggregate_min = 4,
+		aggregate_max = 8,
+		aggregate_sum_of_squares = 16,
+		aggregate_all = 31
+	};
+	
 	enum rotate_operation {rotate_left, rotate_right, num_rotate_ops};
 	const char* const rotate_op_to_str[] = {"(i + size - 1) \% size", "(i + 1) \% size"};
 	
@@ -82,7 +116,7 @@ namespace PV {
 	template<> const char* typeToStr<signed char>() { return "char"; }
 	template<> const char* typeToStr<unsigned char>() { return "unsigned char"; }
 	template<> const char* typeToStr<short>() { return "short"; }
-	template<> const char* typeToStr<uint16_t>() { return "unsigned char"; }
+	template<> const char* typeToStr<uint16_t>() { return "unsigned short"; }
 	template<> const char* typeToStr<int>() { return "int"; }
 	template<> const char* typeToStr<unsigned int>() { return "unsigned int"; }
 	template<> const char* typeToStr<long>() { return "long"; }
@@ -92,9 +126,132 @@ namespace PV {
 	template<> const char* typeToStr<float>() { return "float"; }
 	//template<> const char* typeToStr<double>() { return "double"; }   // not supported by all devices
 	
+	// opencl vector type prefix (e.g. "uchar" for uchar4) of supported data types, nullptr if not vectorizable
+	template<typename T> static const char* typeToVecStr() { return nullptr; }
+	template<> const char* typeToVecStr<char>() { return "char"; }
+	template<> const char* typeToVecStr<signed char>() { return "char"; }
+	template<> const char* typeToVecStr<unsigned char>() { return "uchar"; }
+	template<> const char* typeToVecStr<short>() { return "short"; }
+	template<> const char* typeToVecStr<uint16_t>() { return "ushort"; }
+	template<> const char* typeToVecStr<int>() { return "int"; }
+	template<> const char* typeToVecStr<unsigned int>() { return "uint"; }
+	template<> const char* typeToVecStr<long>() { return "long"; }
+	template<> const char* typeToVecStr<unsigned long>() { return "ulong"; }
+	template<> const char* typeToVecStr<long long>() { return "long"; }
+	template<> const char* typeToVecStr<unsigned long long>() { return "ulong"; }
+	template<> const char* typeToVecStr<float>() { return "float"; }
+	
+	// default coarsening of untuned elementwise kernels writing bool, which always take the scalar path
+	// since bool has no opencl vector type to vstore the per-lane results into
+	const unsigned bool_output_coarsening = 4;
+	
+	// elementwise operations that have the same meaning on opencl vector types as on scalars
+	// (comparisons yield -1 per lane, and vector shifts mask the shift amount to the element width)
+	static bool vectorizable(enum operation op) {
+		switch (op) {
+			case plus: case minus: case times: case divide: case mod:
+			case negate: case increment: case decrement:
+			case bitwise_and: case bitwise_or: case bitwise_xor: case bitwise_not: case copy:
+				return true;
+			default:
+				return false;
+		}
+	}
+	
+	// generates an elementwise kernel over num_operands buffers (the last one being the output) where each
+	// work-item handles coarsening chunks of width consecutive elements, using vloadN / vstoreN when vec_type
+	// is given and a scalar loop for the tail or for operations that cannot be vectorized; inputs whose bit
+	// is set in broadcast are one-element buffers whose value is used for every element, and inputs whose bit
+	// is set in generated are passed as start and step values and computed as start + i * step
+	static std::string compute_kernel_code(const char* const types[], unsigned num_operands, const char* vec_type, unsigned width,
+	                                       unsigned coarsening, enum operation op, unsigned broadcast = 0, unsigned generated = 0) {
+		static const char* const names[] = {"a", "b", "c", "d"};
+		char line[200];
+		std::string params, scalar_body, vector_body;
+		for (unsigned k = 0; k < num_operands; ++k) {
+			const bool generate = (generated >> k) & 1;
+			if (generate) sprintf(line, "const %s %s_start, const %s %s_step, ", types[k], names[k], types[k], names[k]);
+			else sprintf(line, "global %s * %s%s, ", types[k], names[k], names[k]);
+			params += line;
+			if (k + 1 < num_operands && generate) {
+				sprintf(line, "		const %s %s = %s_start + (%s)i * %s_step;\n", types[k], names[k], names[k], types[k], names[k]);
+				scalar_body += line;
+				if (vec_type == nullptr) continue;
+				sprintf(line, "			const %s%u %s = (%s%u)(", vec_type, width, names[k], vec_type, width);
+				vector_body += line;
+				for (unsigned j = 0; j < width; ++j) {
+					sprintf(line, "%s%s_start + (%s)(chunk + %u) * %s_step", j ? ", " : "", names[k], types[k], j, names[k]);
+					vector_body += line;
+				}
+				vector_body += ");\n";
+			} else if (k + 1 < num_operands) {
+				const bool scalar = (broadcast >> k) & 1;
+				sprintf(line, "		const %s %s = %s%s[%s];\n", types[k], names[k], names[k], names[k], scalar ? "0" : "i");
+				scalar_body += line;
+				if (vec_type == nullptr) continue;
+				if (scalar) sprintf(line, "			const %s%u %s = (%s%u)(%s%s[0]);\n", vec_type, width, names[k], vec_type, width, names[k], names[k]);
+				else sprintf(line, "			const %s%u %s = vload%u(0, %s%s + chunk);\n", vec_type, width, names[k], width, names[k], names[k]);
+				vector_body += line;
+			} else {
+				sprintf(line, "		%s %s;\n		%s\n		%s%s[i] = %s;\n", types[k], names[k], op_to_str[op], names[k], names[k], names[k]);
+				scalar_body += line;
+				if (vec_type == nullptr) continue;
+				sprintf(line, "			%s%u %s;\n			%s\n			vstore%u(%s, 0, %s%s + chunk);\n", vec_type, width, names[k], op_to_str[op], width, names[k], names[k], names[k]);
+				vector_body += line;
+			}
+		}
+		const std::string w = std::to_string(width);
+		const std::string n = std::to_string(width * coarsening);
+		std::string code = "__kernel void opencl_compute(" + params + "const unsigned long size) \n"
+			"{\n"
+			"	const unsigned long base = get_global_id(0) * " + n + ";\n"
+			"	if (base >= size) return;\n"
+			"	const unsigned long end = base + " + n + " < size ? base + " + n + " : size;\n";
+		if (vec_type != nullptr) {
+			code += "	if (end - base == " + n + ") {\n"
+				"		for (unsigned long chunk = base; chunk < end; chunk += " + w + ") {\n" + vector_body + "		}\n"
+				"		return;\n"
+				"	}\n";
+		}
+		code += "	for (unsigned long i = base; i < end; ++i) {\n" + scalar_body + "	}\n}";
+		return code;
+	}
+	
+	// launch parameters of a kernel, tuned per device by autotune()
+	struct launch_config {
+		launch_config(size_type local_size = 0, unsigned coarsening = 1, unsigned reduction_amount = 64, size_type reduction_threshold = 10000) :
+			local_size(local_size), coarsening(coarsening), reduction_amount(reduction_amount), reduction_threshold(reduction_threshold) {};
+		size_type local_size;          // work-group size, 0 lets the driver choose
+		unsigned coarsening;           // vector chunks processed by each elementwise work-item
+		unsigned reduction_amount;     // factor by which each reduction pass shrinks the data
+		size_type reduction_threshold; // size below which partial results are combined on the host
+	};
+	
+	// key of a kernel in the tuning profile, e.g. "compute int,int,int 0", op < 0 means any operation
+	static std::string tuning_key(const char* kind, const char* const types[], unsigned num_types, int op) {
+		std::string key(kind);
+		for (unsigned k = 0; k < num_types; ++k) {
+			key += (k == 0) ? " " : ",";
+			key += types[k];
+		}
+		return key + " " + (op < 0 ? std::string("*") : std::to_string(op));
+	}
+	
+	// a kernel launch or buffer fill recorded by a PV::Graph
+	struct graph_command {
+		graph_command() : global_size(0), local_size(0), pattern_size(0), fill_size(0) {};
+		cl::Kernel kernel;
+		size_type global_size, local_size;
+		std::vector<cl::Buffer> buffers;  // keeps the kernel's buffer arguments alive
+		cl::Buffer buffer;
+		std::shared_ptr<const void> pattern;
+		size_type pattern_size, fill_size;
+	};
+	typedef std::vector<graph_command> graph_recording;
+	
 	// forward declare function(s)
 	template<typename T1, typename T2>
-	void parallel_compute(cl::Buffer & aa, cl::Buffer & bb, size_type size, enum operation op);
+	void parallel_compute(const cl::Buffer & aa, cl::Buffer & bb, size_type size, enum operation op);
 	
 	class opencl_helper {
 		public:
@@ -117,6 +274,159 @@ namespace PV {
 				else GPU_queue = cl::CommandQueue(GPU_context, 0, &err);
 				if (err != CL_SUCCESS) GPU_available = false;
 			}
+			
+			// preferred vector widths of the compute device, used to size elementwise work-items
+			char_width = short_width = int_width = long_width = float_width = 1;
+			compute_units = 1;
+			local_memory = 0;
+			try {
+				cl::Device device = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front();
+				compute_units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+				local_memory = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+				char_width = clamp_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR>());
+				short_width = clamp_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT>());
+				int_width = clamp_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT>());
+				long_width = clamp_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG>());
+				float_width = clamp_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>());
+			} catch (cl::Error & error) {}
+			
+			const char* options = getenv("PV_BUILD_OPTIONS");
+			build_options = options ? options : "";
+			
+			const char* tuning_path = getenv("PV_TUNING_FILE");
+			tuning_file = tuning_path ? tuning_path : "ParallelVector.tuning";
+			tuning_loaded = false;
+			
+			// SVM is only used when the compute device supports fine-grained buffer sharing
+			SVM_available = false;
+			SVM_enabled = false;
+#if defined(CL_VERSION_2_0)
+			try {
+				cl::Device device = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front();
+				cl_device_svm_capabilities caps = 0;
+				err = clGetDeviceInfo(device(), CL_DEVICE_SVM_CAPABILITIES, sizeof(caps), &caps, nullptr);
+				if (err == CL_SUCCESS && (caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER)) SVM_available = true;
+			} catch (cl::Error & error) {
+				SVM_available = false;
+			}
+#endif
+		}
+		
+		// select the storage used by newly allocated Vectors, falls back to buffers without SVM support
+		bool set_storage_mode(enum storage_mode mode) {
+			SVM_enabled = (mode == svm_storage) && SVM_available;
+			return mode == buffer_storage || SVM_enabled;
+		}
+		enum storage_mode get_storage_mode() const { return SVM_enabled ? svm_storage : buffer_storage; }
+		bool SVM_supported() const { return SVM_available; }
+		
+		// number of elements of type T the device prefers to process at once
+		template<typename T>
+		unsigned vector_width() const {
+			if (std::is_same<T, float>::value) return float_width;
+			switch (sizeof(T)) {
+				case 1: return char_width;
+				case 2: return short_width;
+				case 4: return int_width;
+				default: return long_width;
+			}
+		}
+		
+		unsigned get_compute_units() const { return compute_units; }
+		// bytes of local memory available to each work-group
+		size_type get_local_memory() const { return local_memory; }
+		// largest work-group size up to preferred that kernel can be launched with
+		size_type work_group_size(cl::Kernel & kernel, size_type preferred) {
+			cl::Device device = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front();
+			size_type limit = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+			return std::min(preferred, limit);
+		}
+		
+		// whether the device lists the OpenCL extension name, e.g. "cl_khr_int64_base_atomics"
+		bool has_extension(const std::string & name) {
+			cl::Device device = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front();
+			std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+			extensions.erase(std::remove(extensions.begin(), extensions.end(), '\0'), extensions.end());
+			std::istringstream words(extensions);
+			std::string word;
+			while (words >> word) {
+				if (word == name) return true;
+			}
+			return false;
+		}
+		
+		// whether kernel can be launched with bytes of dynamically sized local memory on top of its own, keeping
+		// a sixteenth of the device's local memory in reserve
+		bool fits_local_memory(cl::Kernel & kernel, size_type bytes) {
+			cl::Device device = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front();
+			size_type used = kernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device);
+			return used + bytes + local_memory / 16 <= local_memory;
+		}
+		
+		// allocates a GPU buffer, backed by SVM when enabled, in which case host_ptr is set to the shared allocation
+		template<typename T>
+		cl::Buffer GPU_storage(size_type size, T* & host_ptr) {
+			host_ptr = nullptr;
+			if (!SVM_enabled) return GPU_buffer<T>(size);
+#if defined(CL_VERSION_2_0)
+			cl::Context context = get_GPU_context();
+			T* ptr = (T*)clSVMAlloc(context(), CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER, sizeof(T)*size, 0);
+			if (ptr == nullptr) throw "SVM allocation failed";
+			SVM_allocation* allocation = new SVM_allocation{context, ptr};
+			cl_int err = CL_SUCCESS;
+			cl::Buffer buffer;
+			try {
+				buffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(T)*size, ptr, &err);
+				// the SVM allocation is freed together with the last reference to its buffer
+				err = clSetMemObjectDestructorCallback(buffer(), free_SVM, allocation);
+			} catch (cl::Error & error) {
+				err = error.err();
+			}
+			if (err != CL_SUCCESS) {
+				buffer = cl::Buffer();
+				delete allocation;
+				clSVMFree(context(), ptr);
+				throw "SVM buffer creation failed";
+			}
+			host_ptr = ptr;
+			return buffer;
+#else
+			return GPU_buffer<T>(size);
+#endif
+		}
+		template<typename T>
+		cl::Buffer GPU_storage(size_type size, T fill_value, T* & host_ptr) {
+			if (!SVM_enabled || capture_target()) return GPU_storage<T>(size, std::shared_ptr<const T>(std::make_shared<T>(fill_value)), host_ptr);
+			cl::Buffer buffer = GPU_storage<T>(size, host_ptr);
+			std::fill(host_ptr, host_ptr + size, fill_value);
+			return buffer;
+		}
+		template<typename T>
+		cl::Buffer GPU_storage(size_type size, std::shared_ptr<const T> fill_value, T* & host_ptr) {
+			cl::Buffer buffer = GPU_storage<T>(size, host_ptr);
+			fill_buffer(buffer, fill_value, sizeof(T), size * sizeof(T));
+			return buffer;
+		}
+		template<class iterator_type>
+		cl::Buffer GPU_storage_iter(iterator_type begin, iterator_type end, typename std::iterator_traits<iterator_type>::value_type* & host_ptr) {
+			typedef typename std::iterator_traits<iterator_type>::value_type T;
+			if (!SVM_enabled) {
+				host_ptr = nullptr;
+				return GPU_buffer_iter(begin, end);
+			}
+			cl::Buffer buffer = GPU_storage<T>(end - begin, host_ptr);
+			std::copy(begin, end, host_ptr);
+			return buffer;
+		}
+		template<typename T>
+		cl::Buffer GPU_storage(T* ptr, size_type size, T* & host_ptr) {
+			if (!SVM_enabled) {
+				host_ptr = nullptr;
+				return GPU_buffer<T>(ptr, size);
+			}
+			cl::Buffer buffer = GPU_storage<T>(size, host_ptr);
+			std::copy(ptr, ptr + size, host_ptr);
+			return buffer;
 		}
 		template<typename T>
 		cl::Buffer CPU_buffer(size_type size) {
@@ -145,12 +455,23 @@ namespace PV {
 		template<typename T>
 		cl::Buffer GPU_buffer(size_type size, T fill_value) {
 			cl::Buffer buffer = GPU_buffer<T>(size);
-			cl::Event event;
-			cl_int err = get_GPU_queue().enqueueFillBuffer(buffer, fill_value, 0, size * sizeof(T), nullptr, &event);
-			if (err == CL_SUCCESS) {
-				event.wait();
-				return buffer;
-			} else throw "error filling CPU buffer";
+			fill_buffer(buffer, std::make_shared<T>(fill_value), sizeof(T), size * sizeof(T));
+			return buffer;
+		}
+		// fills buffer with a pattern, which is read again on every replay when recorded into a graph
+		void fill_buffer(cl::Buffer & buffer, std::shared_ptr<const void> pattern, size_type pattern_size, size_type size) {
+			if (graph_recording* recording = capture_target()) {
+				graph_command command;
+				command.buffer = buffer;
+				command.pattern = pattern;
+				command.pattern_size = pattern_size;
+				command.fill_size = size;
+				recording->push_back(command);
+				return;
+			}
+			cl::CommandQueue queue = get_GPU_queue();
+			cl_int err = clEnqueueFillBuffer(queue(), buffer(), pattern.get(), pattern_size, 0, size, 0, nullptr, nullptr);
+			if (err != CL_SUCCESS) throw "error filling GPU buffer";
 		}
 		template<class iterator_type>
 		cl::Buffer CPU_buffer_iter(iterator_type begin, iterator_type end) {
@@ -163,7 +484,7 @@ namespace PV {
 		template<class iterator_type>
 		cl::Buffer GPU_buffer_iter(iterator_type begin, iterator_type end) {
 			cl_int err = CL_SUCCESS;
-			cl::Buffer buffer = cl::Buffer(get_GPU_queue(), begin, end, false, false, &err);
+			cl::Buffer buffer = cl::Buffer(get_transfer_queue(), begin, end, false, false, &err);
 			if (err == CL_SUCCESS) {
 				return buffer;
 			} else throw "error creating GPU buffer from iterators";
@@ -182,13 +503,27 @@ namespace PV {
 			if (err == CL_SUCCESS) return buffer;
 			else throw "error creating GPU buffer from pointer";
 		}
+		// copies buf into a new buffer once after, if set, has completed
 		template<typename T>
-		cl::Buffer duplicate_buffer(cl::Buffer buf, size_type num_filled, size_type num_allocated) {
-			cl::Buffer buffer = GPU_buffer<T>(num_allocated);
-			parallel_compute<T, T>(buf, buffer, num_filled, copy);
+		cl::Buffer duplicate_buffer(cl::Buffer buf, size_type num_filled, size_type num_allocated, T* & host_ptr, const cl::Event & after) {
+			cl::Buffer buffer = GPU_storage<T>(num_allocated, host_ptr);
+			if (after() != nullptr && num_filled > 0 && !capture_target()) {
+				std::vector<cl::Event> events(1, after);
+				get_GPU_queue().enqueueBarrierWithWaitList(&events);
+			}
+			copy_buffer<T>(buf, buffer, num_filled);
 			return buffer;
 		}
 		template<typename T>
+		void copy_buffer(const cl::Buffer & src, cl::Buffer & dst, size_type size) {
+			if (size == 0) return;
+			// graphs only record kernels and fills
+			if (capture_target()) return parallel_compute<T, T>(src, dst, size, copy);
+			cl::CommandQueue queue = get_GPU_queue();
+			cl_int err = queue.enqueueCopyBuffer(src, dst, 0, 0, size * sizeof(T));
+			if (err != CL_SUCCESS) throw "error copying GPU buffer";
+		}
+		template<typename T>
 		cl::Buffer move_buffer(cl::Buffer buf) {
 			cl::Buffer buffer(std::move(buf));
 			return buffer;
@@ -213,7 +548,7 @@ namespace PV {
 		template<typename T>
 		void from_GPU_buffer(cl::Buffer & buf, size_type start, std::vector<T> & vec) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, vec.size());
-			cl::copy(get_GPU_queue(), sub_buf, vec.begin(), vec.end());
+			cl::copy(get_transfer_queue(), sub_buf, vec.begin(), vec.end());
 		}
 		template<typename T>
 		void from_CPU_buffer(cl::Buffer & buf, size_type start, T * data, size_type size) {
@@ -223,7 +558,7 @@ namespace PV {
 		template<typename T>
 		void from_GPU_buffer(cl::Buffer & buf, size_type start, T * data, size_type size) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, size);
-			cl::copy(get_GPU_queue(), sub_buf, data, data + size);
+			cl::copy(get_transfer_queue(), sub_buf, data, data + size);
 		}
 		template<class iterator_type>
 		void from_CPU_buffer(cl::Buffer & buf, size_type start, iterator_type begin, iterator_type end) {
@@ -235,7 +570,7 @@ namespace PV {
 		void from_GPU_buffer(cl::Buffer & buf, size_type start, iterator_type begin, iterator_type end) {
 			typedef typename std::iterator_traits<iterator_type>::value_type T;
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, end-begin);
-			cl::copy(get_GPU_queue(), sub_buf, begin, end);
+			cl::copy(get_transfer_queue(), sub_buf, begin, end);
 		}
 		template<typename T>
 		void to_CPU_buffer(cl::Buffer & buf, size_type start, std::vector<T> & vec) {
@@ -245,7 +580,7 @@ namespace PV {
 		template<typename T>
 		void to_GPU_buffer(cl::Buffer & buf, size_type start, std::vector<T> & vec) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, vec.size());
-			cl::copy(get_GPU_queue(), vec.begin(), vec.end(), sub_buf);
+			cl::copy(get_transfer_queue(), vec.begin(), vec.end(), sub_buf);
 		}
 		template<typename T>
 		void to_CPU_buffer(cl::Buffer & buf, size_type start, T * data, size_type size) {
@@ -255,7 +590,7 @@ namespace PV {
 		template<typename T>
 		void to_GPU_buffer(cl::Buffer & buf, size_type start, T * data, size_type size) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, size);
-			cl::copy(get_GPU_queue(), data, data + size, sub_buf);
+			cl::copy(get_transfer_queue(), data, data + size, sub_buf);
 		}
 		template<class iterator_type>
 		void to_CPU_buffer(cl::Buffer & buf, size_type start, iterator_type begin, iterator_type end) {
@@ -267,7 +602,7 @@ namespace PV {
 		void to_GPU_buffer(cl::Buffer & buf, size_type start, iterator_type begin, iterator_type end) {
 			typedef typename std::iterator_traits<iterator_type>::value_type T;
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, start, end-begin);
-			cl::copy(get_GPU_queue(), begin, end, sub_buf);
+			cl::copy(get_transfer_queue(), begin, end, sub_buf);
 		}
 		
 		template<typename T>
@@ -278,13 +613,13 @@ namespace PV {
 		template<typename T>
 		void set_GPU_buffer_index(cl::Buffer & buf, size_type index, T val) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, index, 1);
-			cl::copy(get_GPU_queue(), &val, &val + 1, sub_buf);
+			cl::copy(get_transfer_queue(), &val, &val + 1, sub_buf);
 		}
 		template<typename T>
 		T get_GPU_buffer_index(cl::Buffer & buf, size_type index) {
 			cl::Buffer sub_buf = get_sub_buffer<T>(buf, index, 1);
 			T val;
-			cl::copy(get_GPU_queue(), sub_buf, &val, &val + 1);
+			cl::copy(get_transfer_queue(), sub_buf, &val, &val + 1);
 			return val;
 		}
 		
@@ -292,187 +627,769 @@ namespace PV {
 		cl::Context get_CPU_context() { return CPU_available ? CPU_context : GPU_context; }
 		cl::Context get_GPU_context() { return GPU_available ? GPU_context : CPU_context; }
 		cl::CommandQueue get_CPU_queue() { return CPU_available ? CPU_queue : GPU_queue; }
-		cl::CommandQueue get_GPU_queue() { return GPU_available ? GPU_queue : CPU_queue; }
+		// queue of the stream bound to the calling thread, or the default queue; work of stream scopes
+		// that ended on this queue is joined before the queue is handed out
+		cl::CommandQueue get_GPU_queue() {
+			queue_binding & binding = thread_binding();
+			cl::CommandQueue queue = binding.bound ? binding.queue : get_default_GPU_queue();
+			if (!binding.joins.empty()) {
+				queue.enqueueBarrierWithWaitList(&binding.joins);
+				binding.joins.clear();
+			}
+			return queue;
+		}
+		cl::CommandQueue get_default_GPU_queue() { return GPU_available ? GPU_queue : CPU_queue; }
+		
+		// queue for blocking transfers between host and device, which cannot be part of a graph; transfers
+		// inside a stream scope also wait for the sibling scopes that ended before it, since the host may
+		// read what they wrote
+		cl::CommandQueue get_transfer_queue() {
+			if (capture_target()) throw "Host transfers are not allowed during graph capture";
+			cl::CommandQueue queue = get_GPU_queue();
+			queue_binding & binding = thread_binding();
+			if (!binding.host_joins.empty()) {
+				queue.enqueueBarrierWithWaitList(&binding.host_joins);
+				binding.host_joins.clear();
+			}
+			return queue;
+		}
+		
+		// waits until the work the calling thread enqueued on its current queue is done
+		void sync() {
+			get_transfer_queue().finish();
+		}
+		
+		// GRAPHS
+		// the recording the calling thread's kernels and fills go to instead of being enqueued, if any
+		static graph_recording* & capture_target() {
+			static thread_local graph_recording* recording = nullptr;
+			return recording;
+		}
+		
+		// STREAMS
+		// kernels and transfers are not waited on individually, in-order queues keep them ordered and reads block
+		struct queue_binding {
+			bool bound;
+			cl::CommandQueue queue;
+			std::vector<cl::Event> joins;       // ends of scopes the next use of queue waits for
+			std::vector<cl::Event> host_joins;  // ends of sibling scopes only host transfers wait for
+		};
+		static queue_binding & thread_binding() {
+			static thread_local queue_binding binding = {false, cl::CommandQueue(), std::vector<cl::Event>(), std::vector<cl::Event>()};
+			return binding;
+		}
+		
+		// KERNELS
+		// returns the kernel called name in the given source, compiling it the first time the source is seen
+		// with the calling thread's build options; kernel objects are per thread since setting their
+		// arguments is not thread-safe, while programs are compiled once and shared by all threads
+		cl::Kernel get_kernel(const std::string & source, const char* name) {
+			const std::string options = get_build_options();
+			const std::string key = options + '\n' + source;
+			static thread_local std::map<std::string, cl::Kernel> thread_kernels;
+			std::map<std::string, cl::Kernel>::iterator it = thread_kernels.find(key);
+			if (it != thread_kernels.end()) return it->second;
+			
+			std::shared_ptr<program_entry> entry;
+			{
+				std::lock_guard<std::mutex> lock(program_mutex);
+				std::shared_ptr<program_entry> & cached = program_cache[key];
+				if (!cached) cached = std::make_shared<program_entry>();
+				entry = cached;
+			}
+			// threads needing a program that is being compiled wait for it instead of compiling it again
+			std::call_once(entry->compiled, [&]() {
+				try {
+					cl::Program program(get_GPU_context(), source, false);
+					program.build(options.c_str());
+					entry->program = program;
+				} catch (cl::Error & err) {}
+			});
+			if (entry->program() == nullptr) throw "Error encountered during OpenCL compilation";
+			cl::Kernel kernel;
+			try {
+				kernel = cl::Kernel(entry->program, name);
+			} catch (cl::Error & err) {
+				throw "Error encountered during OpenCL compilation";
+			}
+			thread_kernels[key] = kernel;
+			return kernel;
+		}
+		
+		// options passed to the OpenCL compiler for kernels built from now on, defaults to $PV_BUILD_OPTIONS
+		void set_build_options(const std::string & options) {
+			std::lock_guard<std::mutex> lock(program_mutex);
+			build_options = options;
+		}
+		// build options of the calling thread, which differ from the global ones inside a PV::build_options scope
+		std::string get_build_options() {
+			if (scoped_build_options().active) return scoped_build_options().options;
+			std::lock_guard<std::mutex> lock(program_mutex);
+			return build_options;
+		}
+		struct thread_build_options {
+			bool active;
+			std::string options;
+		};
+		static thread_build_options & scoped_build_options() {
+			static thread_local thread_build_options options = {false, ""};
+			return options;
+		}
+		
+		// enqueues kernel with the given arguments over global work-items, which are rounded up
+		// to a multiple of local_size when one is given
+		template<typename... arg_types>
+		cl::Event enqueue_kernel(cl::Kernel kernel, size_type global_size, size_type local_size, const arg_types&... args) {
+			if (local_size > 0) global_size = (global_size + local_size - 1) / local_size * local_size;
+			if (graph_recording* recording = capture_target()) {
+				// recorded kernels get their own kernel object, so their arguments stay set for every replay
+				graph_command command;
+				try {
+					command.kernel = cl::Kernel(kernel.getInfo<CL_KERNEL_PROGRAM>(), kernel.getInfo<CL_KERNEL_FUNCTION_NAME>().c_str());
+				} catch (cl::Error & err) {
+					throw "error recording OpenCL kernel";
+				}
+				set_kernel_args(command.kernel, 0, args...);
+				keep_buffers(command.buffers, args...);
+				command.global_size = global_size;
+				command.local_size = local_size;
+				recording->push_back(command);
+				return cl::Event();
+			}
+			set_kernel_args(kernel, 0, args...);
+			cl::NDRange local_range = cl::NullRange;
+			if (local_size > 0) local_range = cl::NDRange(local_size);
+			cl::Event event;
+			cl::CommandQueue queue = get_GPU_queue();
+			cl_int err = queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global_size), local_range, nullptr, &event);
+			if (err != CL_SUCCESS) throw "error enqueueing OpenCL kernel";
+			return event;
+		}
+		
+		// TUNING
+		// launch parameters for the kernel with the given key, falling back to the tuned default for
+		// the kernel's kind and first type, then to the built-in defaults
+		launch_config get_tuning(const std::string & key) {
+			std::lock_guard<std::recursive_mutex> lock(tuning_mutex);
+			if (!tuning_loaded) load_tuning(tuning_file);
+			std::map<std::string, launch_config>::iterator it = tuning.find(key);
+			if (it != tuning.end()) return it->second;
+			// the first type ends at the first ',' or, for a single type, at the space before the operation,
+			// since type names such as "unsigned int" contain spaces themselves
+			size_t type_end = std::min(key.find(',', key.find(' ') + 1), key.rfind(' '));
+			it = tuning.find(key.substr(0, type_end) + " *");
+			if (it != tuning.end()) return it->second;
+			// elementwise kernels writing bool (comparisons and logical operations) have no vector path,
+			// so by default each work-item loops over more elements to amortize its launch
+			const size_t op_start = key.rfind(' ');
+			if (key.compare(0, 8, "compute ") == 0 && op_start >= 12 && key.compare(op_start - 4, 4, "bool") == 0)
+				return launch_config(0, bool_output_coarsening);
+			return launch_config();
+		}
+		void set_tuning(const std::string & key, const launch_config & config) {
+			std::lock_guard<std::recursive_mutex> lock(tuning_mutex);
+			if (!tuning_loaded) load_tuning(tuning_file);
+			tuning[key] = config;
+		}
+		// profile file used by get_tuning() and save_tuning(), defaults to $PV_TUNING_FILE or ParallelVector.tuning
+		void set_tuning_file(const std::string & path) {
+			std::lock_guard<std::recursive_mutex> lock(tuning_mutex);
+			tuning_file = path;
+			tuning.clear();
+			tuning_loaded = false;
+		}
+		// reads the entries for the current device from a profile file, returns false if it could not be read
+		bool load_tuning(const std::string & path) {
+			std::lock_guard<std::recursive_mutex> lock(tuning_mutex);
+			tuning_loaded = true;
+			std::ifstream file(path.c_str());
+			if (!file) return false;
+			const std::string device = device_name();
+			std::string line;
+			while (std::getline(file, line)) {
+				std::istringstream fields(line);
+				std::string line_device, key;
+				launch_config config;
+				if (!std::getline(fields, line_device, '\t') || line_device != device) continue;
+				if (!std::getline(fields, key, '\t')) continue;
+				if (fields >> config.local_size >> config.coarsening >> config.reduction_amount >> config.reduction_threshold) {
+					tuning[key] = config;
+				}
+			}
+			return true;
+		}
+		// writes the tuned entries of the current device to the profile file, keeping other devices' entries
+		bool save_tuning() {
+			std::lock_guard<std::recursive_mutex> lock(tuning_mutex);
+			const std::string device = device_name();
+			std::string other_devices, line;
+			std::ifstream in_file(tuning_file.c_str());
+			while (std::getline(in_file, line)) {
+				if (line.compare(0, device.size() + 1, device + "\t") != 0) other_devices += line + "\n";
+			}
+			in_file.close();
+			std::ofstream file(tuning_file.c_str());
+			if (!file) return false;
+			file << other_devices;
+			for (std::map<std::string, launch_config>::iterator it = tuning.begin(); it != tuning.end(); ++it) {
+				const launch_config & config = it->second;
+				file << device << '\t' << it->first << '\t' << config.local_size << ' ' << config.coarsening << ' '
+				     << config.reduction_amount << ' ' << config.reduction_threshold << '\n';
+			}
+			return bool(file);
+		}
+		// name of the compute device, identifies its entries in the profile file
+		std::string device_name() {
+			std::string name;
+			try {
+				name = get_GPU_context().getInfo<CL_CONTEXT_DEVICES>().front().getInfo<CL_DEVICE_NAME>();
+			} catch (cl::Error & err) {}
+			name = name.c_str();  // drop trailing null characters
+			std::replace(name.begin(), name.end(), '\t', ' ');
+			return name;
+		}
 		
 		private:
+		struct program_entry {
+			std::once_flag compiled;
+			cl::Program program;
+		};
+		
+		static void keep_buffers(std::vector<cl::Buffer> & buffers) {}
+		template<typename arg_type, typename... arg_types>
+		static void keep_buffers(std::vector<cl::Buffer> & buffers, const arg_type & arg, const arg_types&... args) {
+			keep_buffers(buffers, args...);
+		}
+		template<typename... arg_types>
+		static void keep_buffers(std::vector<cl::Buffer> & buffers, const cl::Buffer & arg, const arg_types&... args) {
+			buffers.push_back(arg);
+			keep_buffers(buffers, args...);
+		}
+		
+		static void set_kernel_args(cl::Kernel & kernel, cl_uint index) {}
+		template<typename arg_type, typename... arg_types>
+		static void set_kernel_args(cl::Kernel & kernel, cl_uint index, const arg_type & arg, const arg_types&... args) {
+			kernel.setArg(index, arg);
+			set_kernel_args(kernel, index + 1, args...);
+		}
+		
+#if defined(CL_VERSION_2_0)
+		struct SVM_allocation {
+			cl::Context context;
+			void* ptr;
+		};
+		static void CL_CALLBACK free_SVM(cl_mem buffer, void* user_data) {
+			SVM_allocation* allocation = (SVM_allocation*)user_data;
+			clSVMFree(allocation->context(), allocation->ptr);
+			delete allocation;
+		}
+#endif
+		
+		// round a preferred vector width down to a valid opencl vector size (1, 2, 4, 8 or 16)
+		static unsigned clamp_width(cl_uint width) {
+			unsigned clamped = 1;
+			while (clamped * 2 <= width && clamped < 16) clamped *= 2;
+			return clamped;
+		}
+		
 		bool CPU_available, GPU_available;
+		bool SVM_available, SVM_enabled;
+		unsigned char_width, short_width, int_width, long_width, float_width;
+		unsigned compute_units;
+		size_type local_memory;
 		cl::Context CPU_context, GPU_context;
 		cl::CommandQueue CPU_queue, GPU_queue;
+		std::map<std::string, std::shared_ptr<program_entry> > program_cache;
+		std::string build_options;
+		std::mutex program_mutex;
+		std::map<std::string, launch_config> tuning;
+		std::recursive_mutex tuning_mutex;
+		std::string tuning_file;
+		bool tuning_loaded;
 	};
 	
 	opencl_helper cl;
 	
-	template<typename T1, typename T2>
-	void parallel_compute(cl::Buffer & aa, cl::Buffer & bb, size_type size, enum operation op) {
-		static const char* const starting_kernel_code =
-			"__kernel void opencl_compute(global %s * aa, global %s * bb) \n"
-			"{                                                            \n"
-			"	const size_t i = get_global_id(0);                       \n"
-			"	const %s a = aa[i];                                      \n"
-			"	%s b;                                                    \n"
-			"	%s                                                       \n"
-			"	bb[i] = b;                                               \n"
-			"}";
-		
-		static cl::Program program[num_ops];
-		static cl::Kernel kernel[num_ops];
-		static bool initialized[num_ops];
-		if (!initialized[op]) {
-			const char *T1_str = typeToStr<T1>();
-			const char *T2_str = typeToStr<T2>();
-			if (T1_str == nullptr || T2_str == nullptr) throw "Unsupported type in computation";
-			const char *op_str = op_to_str[op];
-			//printf("%s\n", op_str);
-			char kernel_code[1500];
-			sprintf(kernel_code, starting_kernel_code, T1_str, T2_str, T1_str, T2_str, op_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program[op] = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
+	// adds compiler options to every kernel the current thread builds while it is in scope, e.g.
+	//     PV::build_options scope("-cl-mad-enable");
+	class build_options {
+		public:
+			explicit build_options(const std::string & options) : previous(opencl_helper::scoped_build_options()) {
+				const std::string current = cl.get_build_options();
+				opencl_helper::thread_build_options & scoped = opencl_helper::scoped_build_options();
+				scoped.options = (current.empty() || options.empty()) ? current + options : current + " " + options;
+				scoped.active = true;
+			}
+			~build_options() {
+				opencl_helper::scoped_build_options() = previous;
+			}
+		private:
+			build_options(const build_options &);
+			build_options & operator=(const build_options &);
+			opencl_helper::thread_build_options previous;
+	};
+	
+	// floating point relaxations for kernels the current thread builds while it is in scope, e.g.
+	//     PV::math_mode fast_math(PV::math_mode::fast);
+	class math_mode : public build_options {
+		public:
+			enum mode {
+				precise = 0,
+				mad_enable = 1,
+				no_signed_zeros = 2,
+				denorms_are_zero = 4,
+				finite_math_only = 8,
+				fast = 16
+			};
+			explicit math_mode(int modes) : build_options(mode_to_str(modes)) {}
+		private:
+			static std::string mode_to_str(int modes) {
+				std::string options;
+				if (modes & mad_enable) options += " -cl-mad-enable";
+				if (modes & no_signed_zeros) options += " -cl-no-signed-zeros";
+				if (modes & denorms_are_zero) options += " -cl-denorms-are-zero";
+				if (modes & finite_math_only) options += " -cl-finite-math-only";
+				if (modes & fast) options += " -cl-fast-relaxed-math";
+				return options.empty() ? options : options.substr(1);
+			}
+	};
+	
+	// a command queue of its own, so that independent work on different streams can overlap on the device
+	class Stream {
+		public:
+			Stream() {
+				cl_int err = CL_SUCCESS;
+				cl::Context context = cl.get_GPU_context();
+				cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>().front();
+				command_queue = cl::CommandQueue(context, device, 0, &err);
+				if (err != CL_SUCCESS) throw "error creating stream";
+			}
+			cl::CommandQueue & queue() {
+				return command_queue;
+			}
+			// event that completes once the work enqueued on the stream so far is done
+			cl::Event record() {
+				cl::Event event;
+				command_queue.enqueueMarkerWithWaitList(nullptr, &event);
+				return event;
+			}
+			// makes the work enqueued on the stream from now on wait for event
+			void wait(const cl::Event & event) {
+				std::vector<cl::Event> events(1, event);
+				command_queue.enqueueBarrierWithWaitList(&events);
+			}
+			void wait(Stream & stream) {
+				wait(stream.record());
+			}
+			// blocks until the work enqueued on the stream is done
+			void synchronize() {
+				command_queue.finish();
+			}
+			// runs function with the stream bound to the calling thread
+			template<class function_type>
+			void run(function_type function);
+		private:
+			cl::CommandQueue command_queue;
+	};
+	
+	// binds a stream to the calling thread while in scope, so PV operations of the thread are enqueued on it;
+	// the stream first waits for the work the thread enqueued on the outer queue, and work enqueued on the
+	// outer queue after the scope waits for the stream; sibling scopes, one after the other on the same
+	// thread, overlap on the device, so kernels reading what a sibling wrote need stream.wait(sibling),
+	// while host reads inside a scope wait for the siblings that ended before it on their own
+	class stream_scope {
+		public:
+			explicit stream_scope(Stream & stream) : previous(opencl_helper::thread_binding()) {
+				// the ends of sibling scopes stay pending on the outer queue instead of delaying this stream
+				cl::CommandQueue outer = previous.bound ? previous.queue : cl.get_default_GPU_queue();
+				cl::Event start;
+				outer.enqueueMarkerWithWaitList(nullptr, &start);
+				stream.wait(start);
+				opencl_helper::queue_binding & binding = opencl_helper::thread_binding();
+				binding.bound = true;
+				binding.queue = stream.queue();
+				binding.joins.clear();
+				binding.host_joins.insert(binding.host_joins.end(), previous.joins.begin(), previous.joins.end());
+			}
+			~stream_scope() {
+				cl::Event end;
+				cl.get_GPU_queue().enqueueMarkerWithWaitList(nullptr, &end);
+				opencl_helper::queue_binding & binding = opencl_helper::thread_binding();
+				binding = previous;
+				binding.joins.push_back(end);
+			}
+		private:
+			stream_scope(const stream_scope &);
+			stream_scope & operator=(const stream_scope &);
+			opencl_helper::queue_binding previous;
+	};
+	
+	template<class function_type>
+	void Stream::run(function_type function) {
+		stream_scope scope(*this);
+		function();
+	}
+	
+	// a value used by a graph, which can be changed between launches without capturing the graph again
+	template<typename T>
+	class graph_param {
+		public:
+			explicit graph_param(T value = T()) : value(std::make_shared<T>(value)) {};
+			void set(T new_value) {
+				*value = new_value;
+			}
+			T get() const {
+				return *value;
+			}
+		private:
+			std::shared_ptr<T> value;
+			template<typename U>
+			friend class Vector;
+	};
+	
+	// a sequence of PV operations recorded once and then enqueued again with a single call per launch;
+	// the host is not involved between the recorded kernels, so reading Vectors is not allowed while capturing
+	class Graph {
+		public:
+			Graph() {};
+			// records the kernels and fills enqueued by function on the calling thread, without running them
+			template<class function_type>
+			void capture(function_type function) {
+				graph_recording* & target = opencl_helper::capture_target();
+				if (target) throw "Graph capture already in progress";
+				graph_recording recording;
+				target = &recording;
+				try {
+					function();
+				} catch (...) {
+					target = nullptr;
+					throw;
+				}
+				target = nullptr;
+				commands.insert(commands.end(), recording.begin(), recording.end());
+			}
+			// enqueues the recorded work on the calling thread's current queue
+			void launch() {
+				cl::CommandQueue queue = cl.get_GPU_queue();
+				for (size_type i = 0; i < commands.size(); ++i) {
+					const graph_command & command = commands[i];
+					cl_int err;
+					if (command.kernel()) {
+						size_t global_size = command.global_size, local_size = command.local_size;
+						err = clEnqueueNDRangeKernel(queue(), command.kernel(), 1, nullptr, &global_size, local_size > 0 ? &local_size : nullptr, 0, nullptr, nullptr);
+					} else {
+						err = clEnqueueFillBuffer(queue(), command.buffer(), command.pattern.get(), command.pattern_size, 0, command.fill_size, 0, nullptr, nullptr);
+					}
+					if (err != CL_SUCCESS) throw "error launching graph";
+				}
 			}
-			kernel[op] = cl::Kernel(program[op], "opencl_compute");
-			initialized[op] = true;
+			size_type size() const {
+				return commands.size();
+			}
+			void clear() {
+				commands.clear();
+			}
+		private:
+			graph_recording commands;
+	};
+	
+	// compiles (or fetches from the cache) the elementwise kernel for op, choosing the vector path
+	// when every operand has the same vectorizable type
+	static cl::Kernel compute_kernel(const char* const types[], unsigned num_operands, const char* vec_type, unsigned width,
+	                                 unsigned coarsening, enum operation op, unsigned broadcast = 0, unsigned generated = 0) {
+		for (unsigned k = 0; k < num_operands; ++k) {
+			if (types[k] == nullptr) throw "Unsupported type in computation";
+			if (strcmp(types[k], types[0]) != 0) vec_type = nullptr;
 		}
+		if (width == 1 || !vectorizable(op)) vec_type = nullptr;
+		std::string kernel_code = compute_kernel_code(types, num_operands, vec_type, width, coarsening, op, broadcast, generated);
+		//printf("%s\n", kernel_code.c_str());
+		return cl.get_kernel(kernel_code, "opencl_compute");
+	}
+	
+	template<typename T1, typename T2>
+	void parallel_compute(const cl::Buffer & aa, cl::Buffer & bb, size_type size, enum operation op) {
+		const char* const types[] = {typeToStr<T1>(), typeToStr<T2>()};
+		const launch_config config = cl.get_tuning(tuning_key("compute", types, 2, op));
+		const unsigned width = cl.vector_width<T1>();
+		cl::Kernel kernel = compute_kernel(types, 2, typeToVecStr<T1>(), width, config.coarsening, op);
+		if (size == 0) return;
 		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer>(kernel[op]))(cl::EnqueueArgs(queue, cl::NDRange(size)), aa, bb);
-		event.wait();
+		const size_type per_item = width * config.coarsening;
+		cl.enqueue_kernel(kernel, (size + per_item - 1) / per_item, config.local_size, aa, bb, (cl_ulong)size);
 	}
 	
 	template<typename T1, typename T2, typename T3>
-	void parallel_compute(cl::Buffer & aa, const cl::Buffer & bb, cl::Buffer & cc, size_type size, enum operation op) {
-		static const char* const starting_kernel_code =
-			"__kernel void opencl_compute(global %s * aa, global %s * bb, global %s * cc) \n"
-			"{                                      \n"
-			"	const size_t i = get_global_id(0); \n"
-			"	const %s a = aa[i];                \n"
-			"	const %s b = bb[i];                \n"
-			"	%s c;                              \n"
-			"	%s                                 \n"
-			"	cc[i] = c;                         \n"
-			"}";
-		
-		static cl::Program program[num_ops];
-		static cl::Kernel kernel[num_ops];
-		static bool initialized[num_ops];
-		cl_int err = CL_SUCCESS;
-		if (!initialized[op]) {
-			const char *T1_str = typeToStr<T1>();
-			const char *T2_str = typeToStr<T2>();
-			const char *T3_str = typeToStr<T3>();
-			if (T1_str == nullptr || T2_str == nullptr || T3_str == nullptr) throw "Unsupported type in computation";
-			const char *op_str = op_to_str[op];
-			//printf("%s\n", op_str);
-			char kernel_code[1500];
-			sprintf(kernel_code, starting_kernel_code, T1_str, T2_str, T3_str, T1_str, T2_str, T3_str, op_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program[op] = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
-			}
-			kernel[op] = cl::Kernel(program[op], "opencl_compute");
-			initialized[op] = true;
-		}
+	void parallel_compute(const cl::Buffer & aa, const cl::Buffer & bb, cl::Buffer & cc, size_type size, enum operation op, unsigned broadcast = 0) {
+		const char* const types[] = {typeToStr<T1>(), typeToStr<T2>(), typeToStr<T3>()};
+		const launch_config config = cl.get_tuning(tuning_key("compute", types, 3, op));
+		const unsigned width = cl.vector_width<T1>();
+		cl::Kernel kernel = compute_kernel(types, 3, typeToVecStr<T1>(), width, config.coarsening, op, broadcast);
+		if (size == 0) return;
 		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer>(kernel[op]))(cl::EnqueueArgs(queue, cl::NDRange(size)), aa, bb, cc);
-		event.wait();
+		const size_type per_item = width * config.coarsening;
+		cl.enqueue_kernel(kernel, (size + per_item - 1) / per_item, config.local_size, aa, bb, cc, (cl_ulong)size);
 	}
 	
 	template<typename T1, typename T2, typename T3, typename T4>
-	void parallel_compute(cl::Buffer & aa, const cl::Buffer & bb, const cl::Buffer & cc, cl::Buffer & dd, size_type size, enum operation op) {
-		static const char* const starting_kernel_code =
-			"__kernel void opencl_compute(global %s * aa, global %s * bb, global %s * cc, global %s * dd) \n"
-			"{                                      \n"
-			"	const size_t i = get_global_id(0); \n"
-			"	const %s a = aa[i];                \n"
-			"	const %s b = bb[i];                \n"
-			"	const %s c = cc[i];                \n"
-			"	%s d;                              \n"
-			"	%s                                 \n"
-			"	dd[i] = d;                         \n"
-			"}";
+	void parallel_compute(const cl::Buffer & aa, const cl::Buffer & bb, const cl::Buffer & cc, cl::Buffer & dd, size_type size, enum operation op) {
+		const char* const types[] = {typeToStr<T1>(), typeToStr<T2>(), typeToStr<T3>(), typeToStr<T4>()};
+		const launch_config config = cl.get_tuning(tuning_key("compute", types, 4, op));
+		const unsigned width = cl.vector_width<T1>();
+		cl::Kernel kernel = compute_kernel(types, 4, typeToVecStr<T1>(), width, config.coarsening, op);
+		if (size == 0) return;
 		
-		static cl::Program program[num_ops];
-		static cl::Kernel kernel[num_ops];
-		static bool initialized[num_ops];
-		cl_int err = CL_SUCCESS;
-		if (!initialized[op]) {
-			const char *T1_str = typeToStr<T1>();
-			const char *T2_str = typeToStr<T2>();
-			const char *T3_str = typeToStr<T3>();
-			const char *T4_str = typeToStr<T4>();
-			if (T1_str == nullptr || T2_str == nullptr || T3_str == nullptr || T4_str == nullptr) throw "Unsupported type in computation";
-			const char *op_str = op_to_str[op];
-			//printf("%s\n", op_str);
-			char kernel_code[1500];
-			sprintf(kernel_code, starting_kernel_code, T1_str, T2_str, T3_str, T4_str, T1_str, T2_str, T3_str, T4_str, op_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program[op] = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
+		const size_type per_item = width * config.coarsening;
+		cl.enqueue_kernel(kernel, (size + per_item - 1) / per_item, config.local_size, aa, bb, cc, dd, (cl_ulong)size);
+	}
+	
+	// an elementwise input that is either a buffer or, when buffer is null, generated as start + i * step
+	template<typename T>
+	struct compute_operand {
+		compute_operand(const cl::Buffer & buffer) : buffer(&buffer), start(0), step(0) {};
+		compute_operand(T start, T step) : buffer(nullptr), start(start), step(step) {};
+		const cl::Buffer* buffer;
+		T start, step;
+	};
+	
+	// writes start + i * step to the first size elements of out
+	template<typename T>
+	void parallel_generate(T start, T step, cl::Buffer & out, size_type size) {
+		const char* const types[] = {typeToStr<T>(), typeToStr<T>()};
+		const launch_config config = cl.get_tuning(tuning_key("compute", types, 2, copy));
+		const unsigned width = cl.vector_width<T>();
+		cl::Kernel kernel = compute_kernel(types, 2, typeToVecStr<T>(), width, config.coarsening, copy, 0, 1);
+		if (size == 0) return;
+		
+		const size_type per_item = width * config.coarsening;
+		cl.enqueue_kernel(kernel, (size + per_item - 1) / per_item, config.local_size, start, step, out, (cl_ulong)size);
+	}
+	
+	// like parallel_compute, with either input possibly generated inside the kernel
+	template<typename T1, typename T2, typename T3>
+	void parallel_compute(const compute_operand<T1> & a, const compute_operand<T2> & b, cl::Buffer & cc, size_type size, enum operation op) {
+		const char* const types[] = {typeToStr<T1>(), typeToStr<T2>(), typeToStr<T3>()};
+		const launch_config config = cl.get_tuning(tuning_key("compute", types, 3, op));
+		const unsigned width = cl.vector_width<T1>();
+		const unsigned generated = (a.buffer ? 0 : 1) | (b.buffer ? 0 : 2);
+		cl::Kernel kernel = compute_kernel(types, 3, typeToVecStr<T1>(), width, config.coarsening, op, 0, generated);
+		if (size == 0) return;
+		
+		const size_type per_item = width * config.coarsening;
+		const size_type global_size = (size + per_item - 1) / per_item;
+		if (a.buffer && b.buffer) cl.enqueue_kernel(kernel, global_size, config.local_size, *a.buffer, *b.buffer, cc, (cl_ulong)size);
+		else if (a.buffer) cl.enqueue_kernel(kernel, global_size, config.local_size, *a.buffer, b.start, b.step, cc, (cl_ulong)size);
+		else if (b.buffer) cl.enqueue_kernel(kernel, global_size, config.local_size, a.start, a.step, *b.buffer, cc, (cl_ulong)size);
+		else cl.enqueue_kernel(kernel, global_size, config.local_size, a.start, a.step, b.start, b.step, cc, (cl_ulong)size);
+	}
+	
+	// runs the continuations of awaited Futures in order on a worker thread started on first use; event
+	// callbacks must not make blocking OpenCL calls, which any PV operation after co_await may do
+	class continuation_executor {
+		public:
+			static continuation_executor & instance() {
+				static continuation_executor executor;
+				return executor;
+			}
+			void post(std::function<void()> task) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!worker.joinable()) worker = std::thread(&continuation_executor::run, this);
+					tasks.push_back(std::move(task));
+				}
+				available.notify_one();
+			}
+			~continuation_executor() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				available.notify_one();
+				if (worker.joinable()) worker.join();
+			}
+		private:
+			continuation_executor() : stopping(false) {};
+			continuation_executor(const continuation_executor &);
+			continuation_executor & operator=(const continuation_executor &);
+			void run() {
+				while (true) {
+					std::function<void()> task;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+						if (tasks.empty()) return;
+						task = std::move(tasks.front());
+						tasks.pop_front();
+					}
+					task();
+				}
+			}
+			std::mutex mutex;
+			std::condition_variable available;
+			std::deque<std::function<void()>> tasks;
+			bool stopping;
+			std::thread worker;
+	};
+	
+	// result of device work that is read back without blocking the calling thread; the value is
+	// completed from the OpenCL runtime's event callback, and get() waits for it like std::future
+	template<typename T>
+	class Future {
+		struct shared_state {
+			explicit shared_state(T initial) : value(std::move(initial)), ready(false), error(nullptr) {};
+			std::mutex mutex;
+			std::condition_variable done;
+			T value;
+			bool ready;
+			const char* error;
+			std::function<void(T &)> finish;  // completes value on the host once the read is done
+			cl::Buffer buffer;  // keeps the buffer being read alive
+			std::vector<std::function<void()>> continuations;
+		};
+		public:
+			Future() {};
+			bool valid() const {
+				return state != nullptr;
 			}
-			kernel[op] = cl::Kernel(program[op], "opencl_compute");
-			initialized[op] = true;
+			bool ready() const {
+				if (!state) throw "Future has no state";
+				std::lock_guard<std::mutex> lock(state->mutex);
+				return state->ready;
+			}
+			void wait() const {
+				if (!state) throw "Future has no state";
+				std::unique_lock<std::mutex> lock(state->mutex);
+				state->done.wait(lock, [this]() { return state->ready; });
+			}
+			// waits for the result and moves it out, so like std::future it is meant to be called once
+			T get() {
+				wait();
+				if (state->error) throw state->error;
+				return std::move(state->value);
+			}
+#if defined(__cpp_impl_coroutine)
+			// awaitable: co_await resumes the coroutine on the continuation_executor's worker thread
+			bool await_ready() const {
+				return ready();
+			}
+			bool await_suspend(std::coroutine_handle<> handle) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (state->ready) return false;
+				state->continuations.push_back([handle]() { handle.resume(); });
+				return true;
+			}
+			T await_resume() {
+				return get();
+			}
+#endif
+		private:
+			std::shared_ptr<shared_state> state;
+			
+			static void CL_CALLBACK complete(cl_event event, cl_int status, void* user_data) {
+				std::unique_ptr<std::shared_ptr<shared_state>> holder(static_cast<std::shared_ptr<shared_state>*>(user_data));
+				shared_state & s = **holder;
+				std::vector<std::function<void()>> continuations;
+				{
+					std::lock_guard<std::mutex> lock(s.mutex);
+					if (status < 0) s.error = "error reading GPU buffer";
+					else {
+						try {
+							s.finish(s.value);
+						} catch (char const * error) {
+							s.error = error;
+						}
+					}
+					s.ready = true;
+					continuations.swap(s.continuations);
+				}
+				s.done.notify_all();
+				// awaiting coroutines are handed to the executor rather than resumed inside the callback
+				for (size_type i = 0; i < continuations.size(); ++i) continuation_executor::instance().post(continuations[i]);
+			}
+			
+			template<typename U, typename R>
+			friend Future<U> async_read(cl::Buffer buffer, size_type start, size_type size, U initial,
+			                            std::function<void(U &, const R *)> finish);
+	};
+	
+	// reads size elements of type R starting at start without blocking, then calls finish with them
+	// to complete the future's value, which starts out as initial
+	template<typename T, typename R>
+	Future<T> async_read(cl::Buffer buffer, size_type start, size_type size, T initial,
+	                     std::function<void(T &, const R *)> finish) {
+		Future<T> future;
+		future.state = std::make_shared<typename Future<T>::shared_state>(std::move(initial));
+		std::shared_ptr<R> host(new R[size], std::default_delete<R[]>());
+		future.state->finish = [host, finish](T & value) { finish(value, host.get()); };
+		future.state->buffer = buffer;
+		if (size == 0) {
+			future.state->finish(future.state->value);
+			future.state->ready = true;
+			return future;
 		}
-		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(kernel[op]))(cl::EnqueueArgs(queue, cl::NDRange(size)), aa, bb, cc, dd);
-		event.wait();
+		cl::CommandQueue queue = cl.get_transfer_queue();
+		cl_event event;
+		cl_int err = clEnqueueReadBuffer(queue(), buffer(), CL_FALSE, start * sizeof(R), size * sizeof(R), host.get(), 0, nullptr, &event);
+		if (err != CL_SUCCESS) throw "error reading GPU buffer";
+		cl::Event read_event(event);
+		std::shared_ptr<typename Future<T>::shared_state>* user_data = new std::shared_ptr<typename Future<T>::shared_state>(future.state);
+		err = clSetEventCallback(event, CL_COMPLETE, &Future<T>::complete, user_data);
+		if (err != CL_SUCCESS) {
+			delete user_data;
+			throw "error setting event callback";
+		}
+		// make sure the read is submitted, since nothing else may flush the queue
+		clFlush(queue());
+		return future;
 	}
 	
+	// kernel reducing aa with the given stride, each work-item accumulating one residue class
 	template<typename T>
-	T parallel_reduce(cl::Buffer & aa, size_type size, enum reduce_operation op) {
-		const unsigned reduction_amount = 64;
+	cl::Kernel reduce_kernel(enum reduce_operation op) {
 		static const char* const starting_kernel_code =
-			"__kernel void opencl_reduce(__global %s *aa, __global %s *rr, __const size_t stride, __const size_t size) \n"
+			"__kernel void opencl_reduce(__global %s *aa, __global %s *rr, __const unsigned long stride, __const unsigned long size) \n"
 			"{                                                            \n"
-			"	const size_t start = get_global_id(0);                   \n"
+			"	const unsigned long start = get_global_id(0);            \n"
+			"	if (start >= stride) return;                             \n"
 			"	%s accum = aa[start];                                    \n"
-			"	for(size_t i = start + stride; i < size; i += stride) {  \n"
+			"	for(unsigned long i = start + stride; i < size; i += stride) { \n"
 			"		accum %s aa[i];                                     \n"
 			"	}                                                        \n"
 			"	rr[start] = accum;                                       \n"
 			"}";
-		static cl::Program program[num_reduce_ops];
-		static cl::Kernel kernel[num_reduce_ops];
-		static bool initialized[num_reduce_ops];
-		cl_int err = CL_SUCCESS;
-		if (!initialized[op]) {
-			const char *T_str = typeToStr<T>();
-			if (T_str == nullptr) throw "Unsupported type in computation";
-			const char* op_str = reduce_op_to_str[op];
-			//printf("%s\n", op_str);
-			char kernel_code[700];
-			sprintf(kernel_code, starting_kernel_code, T_str, T_str, T_str, op_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program[op] = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
-			}
-			kernel[op] = cl::Kernel(program[op], "opencl_reduce");
-			initialized[op] = true;
-		}
-		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		const char* op_str = reduce_op_to_str[op];
+		//printf("%s\n", op_str);
+		char kernel_code[700];
+		sprintf(kernel_code, starting_kernel_code, T_str, T_str, T_str, op_str);
+		return cl.get_kernel(kernel_code, "opencl_reduce");
+	}
+	
+	// enqueues the partial reductions of aa, returning the buffer holding the num_partials values left
+	template<typename T>
+	cl::Buffer parallel_reduce_partials(cl::Buffer & aa, size_type size, enum reduce_operation op, size_type & num_partials) {
+		cl::Kernel kernel = reduce_kernel<T>(op);
+		const char *T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("reduce", &T_str, 1, op));
+		const size_type reduction_amount = config.reduction_amount;
 		cl::Buffer in_buf = aa, out_buf;
 		size_type reduced_size, last_size = size;
-		for (reduced_size = size / reduction_amount; reduced_size > 10000; reduced_size /= reduction_amount) {
+		for (reduced_size = size / reduction_amount; reduced_size > config.reduction_threshold; reduced_size /= reduction_amount) {
 			out_buf = cl.GPU_buffer<T>(reduced_size);
-			cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer, const size_t, const size_t>(kernel[op]))(cl::EnqueueArgs(queue, cl::NDRange(reduced_size)), in_buf, out_buf, reduced_size, last_size);
-			event.wait();
+			cl.enqueue_kernel(kernel, reduced_size, config.local_size, in_buf, out_buf, (cl_ulong)reduced_size, (cl_ulong)last_size);
 			in_buf = out_buf;
 			last_size = reduced_size;
 		}
-		std::vector<T> partial_results(last_size);
-		cl.from_GPU_buffer(in_buf, 0, partial_results);
-		T result = partial_results[0];
-		for (size_type i = 1; i < last_size; ++i) {
+		num_partials = last_size;
+		return in_buf;
+	}
+	
+	// finishes a reduction on the host, empty inputs reduce to the operation's identity
+	template<typename T>
+	T combine_partials(const std::vector<T> & partial_results, enum reduce_operation op) {
+		T result = op == reduce_plus ? T(0) : T(1);
+		for (size_type i = 0; i < partial_results.size(); ++i) {
 			if (op == reduce_plus) {result += partial_results[i];}
 			else {result *= partial_results[i];}
 		}
@@ -480,104 +1397,782 @@ namespace PV {
 	}
 	
 	template<typename T>
-	size_type parallel_filter(cl::Buffer & nums, const cl::Buffer & bools, cl::Buffer & results, size_type size) {
-		static const char* const starting_kernel_code =
-			"__kernel void opencl_filter(__global %s *nums, __global bool *bools, __global %s *result, __global unsigned int *current_size) \n"
-			"{                                                             \n"
+	T parallel_reduce(cl::Buffer & aa, size_type size, enum reduce_operation op) {
+		size_type num_partials;
+		cl::Buffer partials = parallel_reduce_partials<T>(aa, size, op, num_partials);
+		std::vector<T> partial_results(num_partials);
+		if (num_partials > 0) cl.from_GPU_buffer(partials, 0, partial_results);
+		return combine_partials(partial_results, op);
+	}
+	
+	// reduces aa to a single element on the device, without reading anything back
+	template<typename T>
+	cl::Buffer parallel_reduce_device(cl::Buffer & aa, size_type size, enum reduce_operation op) {
+		if (size == 0) return cl.GPU_buffer<T>(1, op == reduce_plus ? T(0) : T(1));
+		size_type num_partials;
+		cl::Buffer partials = parallel_reduce_partials<T>(aa, size, op, num_partials);
+		// a single work-item with stride 1 accumulates the remaining partial results
+		cl::Buffer result = cl.GPU_buffer<T>(1);
+		cl.enqueue_kernel(reduce_kernel<T>(op), 1, 0, partials, result, (cl_ulong)1, (cl_ulong)num_partials);
+		return result;
+	}
+	
+	template<typename T>
+	Future<T> parallel_reduce_async(cl::Buffer & aa, size_type size, enum reduce_operation op) {
+		size_type num_partials;
+		cl::Buffer partials = parallel_reduce_partials<T>(aa, size, op, num_partials);
+		return async_read<T, T>(partials, 0, num_partials, T(), [op, num_partials](T & value, const T * partial_results) {
+			value = combine_partials(std::vector<T>(partial_results, partial_results + num_partials), op);
+		});
+	}
+	
+	// condition of the search and count kernels, either whether elements are nonzero (op < 0) or the
+	// comparison op of two buffers, leaving the result in c
+	static void predicate_code(const char* T_str, int op, std::string & params, std::string & condition) {
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		if (op < 0) {
+			params = std::string("global ") + T_str + " *aa, ";
+			condition = "const bool c = aa[i] != 0;";
+		} else {
+			params = std::string("global ") + T_str + " *aa, global " + T_str + " *bb, ";
+			condition = std::string("const ") + T_str + " a = aa[i]; const " + T_str + " b = bb[i]; bool c; " + op_to_str[op];
+		}
+	}
+	
+	// enqueues the filter and returns the buffer that holds the number of kept elements once it is done
+	template<typename T>
+	cl::Buffer parallel_filter_async(cl::Buffer & nums, const cl::Buffer & bools, cl::Buffer & results, size_type size) {
+		static const char* const starting_kernel_code =
+			"__kernel void opencl_filter(__global %s *nums, __global bool *bools, __global %s *result, __global unsigned int *current_size, __const unsigned long size) \n"
+			"{                                                             \n"
 			"	const size_t i = get_global_id(0);                        \n"
-			"	if(bools[i]) {                                            \n"
+			"	if(i < size && bools[i]) {                                \n"
 			"		const unsigned int index = atomic_inc(current_size); \n"
 			"		result[index] = nums[i];                             \n"
 			"	}                                                         \n"
 			"}";
-		static cl::Program program;
-		static cl::Kernel kernel;
-		static bool initialized;
-		cl_int err = CL_SUCCESS;
-		if (!initialized) {
-			const char *T_str = typeToStr<T>();
-			if (T_str == nullptr) throw "Unsupported type in computation";
-			char kernel_code[1000];
-			sprintf(kernel_code, starting_kernel_code, T_str, T_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
-			}
-			kernel = cl::Kernel(program, "opencl_filter");
-			initialized = true;
-		}
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		char kernel_code[1000];
+		sprintf(kernel_code, starting_kernel_code, T_str, T_str);
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_filter");
+		cl::Buffer size_buffer = cl.GPU_buffer<unsigned int>(1, 0);
+		if (size == 0) return size_buffer;
 		
-		cl::CommandQueue queue = cl.get_GPU_queue();
+		const launch_config config = cl.get_tuning(tuning_key("filter", &T_str, 1, -1));
+		cl.enqueue_kernel(kernel, size, config.local_size, nums, bools, results, size_buffer, (cl_ulong)size);
+		return size_buffer;
+	}
+	
+	// like parallel_filter_async, keeping the elements for which the comparison op of aa and bb holds,
+	// which is evaluated inside the filter kernel instead of being stored in a mask first
+	template<typename T, typename U>
+	cl::Buffer parallel_filter_if_async(const cl::Buffer & nums, const cl::Buffer & aa, const cl::Buffer & bb, int op, cl::Buffer & results, size_type size) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		std::string params, condition;
+		predicate_code(typeToStr<U>(), op, params, condition);
+		const std::string kernel_code =
+			std::string("__kernel void opencl_filter_if(global ") + T_str + " *nums, " + params + "global " + T_str + " *result, global unsigned int *current_size, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i >= size) return;\n"
+			"	" + condition + "\n"
+			"	if (c) {\n"
+			"		const unsigned int index = atomic_inc(current_size);\n"
+			"		result[index] = nums[i];\n"
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_filter_if");
 		cl::Buffer size_buffer = cl.GPU_buffer<unsigned int>(1, 0);
-		cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(kernel))(cl::EnqueueArgs(queue, cl::NDRange(size)), nums, bools, results, size_buffer);
-		event.wait();
+		if (size == 0) return size_buffer;
+		
+		const launch_config config = cl.get_tuning(tuning_key("filter", &T_str, 1, op));
+		cl.enqueue_kernel(kernel, size, config.local_size, nums, aa, bb, results, size_buffer, (cl_ulong)size);
+		return size_buffer;
+	}
+	
+	template<typename T>
+	size_type parallel_filter(cl::Buffer & nums, const cl::Buffer & bools, cl::Buffer & results, size_type size) {
+		if (size == 0) return 0;
+		cl::Buffer size_buffer = parallel_filter_async<T>(nums, bools, results, size);
 		return cl.get_GPU_buffer_index<unsigned int>(size_buffer, 0);
 	}
 	
+	// index of the first element whose condition equals want, or size if there is none; work-groups walk
+	// their tiles in increasing order and stop once a match before their next tile has been found; args
+	// are the kernel arguments declared by params
+	template<typename T, typename... Args>
+	size_type parallel_find(const std::string & params, const std::string & condition, int op, bool want, size_type size, const Args &... args) {
+		if (size == 0) return 0;
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to search";
+		const std::string kernel_code =
+			"__kernel void opencl_find(" + params + "volatile global uint *best, const uint want, const unsigned long size, const unsigned long num_tiles) \n"
+			"{\n"
+			"	local uint group_best;\n"
+			"	const unsigned long lid = get_local_id(0), tile_size = get_local_size(0);\n"
+			"	for (unsigned long tile = get_group_id(0); tile < num_tiles; tile += get_num_groups(0)) {\n"
+			"		if (lid == 0) group_best = *best;\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		if (tile * tile_size >= group_best) return;\n"
+			"		const unsigned long i = tile * tile_size + lid;\n"
+			"		if (i < size) {\n"
+			"			" + condition + "\n"
+			"			if (c == want) atomic_min(best, (uint)i);\n"
+			"		}\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_find");
+		
+		const char* T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("find", &T_str, 1, op));
+		const size_type local_size = cl.work_group_size(kernel, config.local_size ? config.local_size : 256);
+		const size_type num_tiles = (size + local_size - 1) / local_size;
+		const size_type num_groups = std::min(num_tiles, (size_type)cl.get_compute_units() * 8);
+		cl::Buffer best = cl.GPU_buffer<cl_uint>(1, 0xFFFFFFFFu);
+		cl.enqueue_kernel(kernel, num_groups * local_size, local_size, args..., best, (cl_uint)want, (cl_ulong)size, (cl_ulong)num_tiles);
+		const cl_uint index = cl.get_GPU_buffer_index<cl_uint>(best, 0);
+		return index == 0xFFFFFFFFu ? size : index;
+	}
+	template<typename T>
+	size_type parallel_find(const cl::Buffer & aa, const cl::Buffer * bb, int op, bool want, size_type size) {
+		std::string params, condition;
+		predicate_code(typeToStr<T>(), op, params, condition);
+		if (bb) return parallel_find<T>(params, condition, op, want, size, aa, *bb);
+		return parallel_find<T>(params, condition, op, want, size, aa);
+	}
+	
+	// number of elements whose condition equals want, counted per work-group in local memory
+	template<typename T, typename... Args>
+	size_type parallel_count(const std::string & params, const std::string & condition, int op, bool want, size_type size, const Args &... args) {
+		if (size == 0) return 0;
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to count";
+		const std::string kernel_code =
+			"__kernel void opencl_count(" + params + "global uint *total, const uint want, const unsigned long size) \n"
+			"{\n"
+			"	local uint group_count;\n"
+			"	if (get_local_id(0) == 0) group_count = 0;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	uint count = 0;\n"
+			"	for (unsigned long i = get_global_id(0); i < size; i += get_global_size(0)) {\n"
+			"		" + condition + "\n"
+			"		count += (c == want);\n"
+			"	}\n"
+			"	atomic_add(&group_count, count);\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	if (get_local_id(0) == 0) atomic_add(total, group_count);\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_count");
+		
+		const char* T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("count", &T_str, 1, op));
+		const size_type local_size = cl.work_group_size(kernel, config.local_size ? config.local_size : 256);
+		const size_type num_groups = std::min((size + local_size - 1) / local_size, (size_type)cl.get_compute_units() * 8);
+		cl::Buffer total = cl.GPU_buffer<cl_uint>(1, 0);
+		cl.enqueue_kernel(kernel, num_groups * local_size, local_size, args..., total, (cl_uint)want, (cl_ulong)size);
+		return cl.get_GPU_buffer_index<cl_uint>(total, 0);
+	}
+	template<typename T>
+	size_type parallel_count(const cl::Buffer & aa, const cl::Buffer * bb, int op, bool want, size_type size) {
+		std::string params, condition;
+		predicate_code(typeToStr<T>(), op, params, condition);
+		if (bb) return parallel_count<T>(params, condition, op, want, size, aa, *bb);
+		return parallel_count<T>(params, condition, op, want, size, aa);
+	}
+	
+	// first pass of a masked reduction: each work-item accumulates the sum and count of the elements of one
+	// residue class whose predicate holds, leaving num_partials of each in sums and counts
+	template<typename T, typename U>
+	size_type parallel_reduce_where_partials(const cl::Buffer & vals, const cl::Buffer & aa, const cl::Buffer * bb, int op,
+	                                         size_type size, cl::Buffer & sums, cl::Buffer & counts) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to count";
+		std::string params, condition;
+		predicate_code(typeToStr<U>(), op, params, condition);
+		const std::string kernel_code =
+			std::string("__kernel void opencl_reduce_where(global ") + T_str + " *vals, " + params +
+			"global " + T_str + " *sums, global uint *counts, const unsigned long stride, const unsigned long size) \n"
+			"{\n"
+			"	const unsigned long start = get_global_id(0);\n"
+			"	if (start >= stride) return;\n"
+			"	" + T_str + " accum = 0;\n"
+			"	uint count = 0;\n"
+			"	for (unsigned long i = start; i < size; i += stride) {\n"
+			"		" + condition + "\n"
+			"		if (c) {\n"
+			"			accum += vals[i];\n"
+			"			++count;\n"
+			"		}\n"
+			"	}\n"
+			"	sums[start] = accum;\n"
+			"	counts[start] = count;\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_reduce_where");
+		if (size == 0) return 0;
+		
+		const launch_config config = cl.get_tuning(tuning_key("reduce_where", &T_str, 1, op));
+		const size_type num_partials = std::min(size, (size_type)cl.get_compute_units() * 256);
+		sums = cl.GPU_buffer<T>(num_partials);
+		counts = cl.GPU_buffer<cl_uint>(num_partials);
+		if (bb) cl.enqueue_kernel(kernel, num_partials, config.local_size, vals, aa, *bb, sums, counts, (cl_ulong)num_partials, (cl_ulong)size);
+		else cl.enqueue_kernel(kernel, num_partials, config.local_size, vals, aa, sums, counts, (cl_ulong)num_partials, (cl_ulong)size);
+		return num_partials;
+	}
+	
+	// sum and count of the elements of vals whose predicate holds, without compacting them
+	template<typename T, typename U>
+	void parallel_reduce_where(const cl::Buffer & vals, const cl::Buffer & aa, const cl::Buffer * bb, int op, size_type size,
+	                           T & sum, size_type & count) {
+		cl::Buffer sums, counts;
+		const size_type num_partials = parallel_reduce_where_partials<T, U>(vals, aa, bb, op, size, sums, counts);
+		std::vector<T> partial_sums(num_partials);
+		std::vector<cl_uint> partial_counts(num_partials);
+		if (num_partials > 0) {
+			cl.from_GPU_buffer(sums, 0, partial_sums);
+			cl.from_GPU_buffer(counts, 0, partial_counts);
+		}
+		sum = combine_partials(partial_sums, reduce_plus);
+		count = 0;
+		for (size_type i = 0; i < num_partials; ++i) count += partial_counts[i];
+	}
+	
+	// the masked sum, or mean when mean is set, left in a one-element buffer on the device
+	template<typename T, typename U>
+	cl::Buffer parallel_reduce_where_device(const cl::Buffer & vals, const cl::Buffer & aa, const cl::Buffer * bb, int op,
+	                                        size_type size, bool mean) {
+		const char *T_str = typeToStr<T>();
+		const std::string kernel_code =
+			std::string("__kernel void opencl_reduce_where_finish(global ") + T_str + " *sums, global uint *counts, global " + T_str + " *result, "
+			"const uint mean, const unsigned long num_partials) \n"
+			"{\n"
+			"	" + T_str + " accum = 0;\n"
+			"	uint count = 0;\n"
+			"	for (unsigned long i = 0; i < num_partials; ++i) {\n"
+			"		accum += sums[i];\n"
+			"		count += counts[i];\n"
+			"	}\n"
+			"	result[0] = mean ? (count > 0 ? accum / (" + T_str + ")count : 0) : accum;\n"
+			"}";
+		cl::Buffer sums, counts;
+		const size_type num_partials = parallel_reduce_where_partials<T, U>(vals, aa, bb, op, size, sums, counts);
+		cl::Buffer result = cl.GPU_buffer<T>(1, T(0));
+		if (num_partials > 0) {
+			cl.enqueue_kernel(cl.get_kernel(kernel_code, "opencl_reduce_where_finish"), 1, 0, sums, counts, result, (cl_uint)mean, (cl_ulong)num_partials);
+		}
+		return result;
+	}
+	
+	// kernel of parallel_histogram, counting into a private histogram in local memory when privatized and
+	// straight into counts otherwise
+	template<typename T>
+	cl::Kernel histogram_kernel(bool bincount, bool privatized) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		// integer offsets from lo are taken exactly in the unsigned type of the same width, which cannot overflow
+		// once v >= lo, and only converted to float to scale them to a bin
+		const std::string T_s = T_str;
+		const std::string F_s = std::is_same<T, double>::value ? "double" : "float";
+		const std::string U_s = std::is_floating_point<T>::value ? T_s : T_s.compare(0, 9, "unsigned ") == 0 ? T_s : "unsigned " + T_s;
+		const std::string bin_code = bincount ?
+			"		const long v = (long)aa[i];\n"
+			"		if (v >= 0 && v < num_bins) atomic_inc(&bins[v]);\n"
+			:
+			"		const " + T_s + " v = aa[i];\n"
+			"		if (v >= lo && v <= hi) atomic_inc(&bins[min((uint)((" + F_s + ")((" + U_s + ")v - (" + U_s + ")lo) * (" + F_s + ")num_bins / "
+			"(" + F_s + ")((" + U_s + ")hi - (" + U_s + ")lo)), num_bins - 1)]);\n";
+		const std::string kernel_code =
+			std::string("__kernel void opencl_histogram(global ") + T_str + " *aa, global uint *counts, local uint *private_counts, "
+			"const uint num_bins, const " + T_str + " lo, const " + T_str + " hi, const unsigned long size) \n"
+			"{\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0);\n" +
+			(privatized ?
+			"	local uint *bins = private_counts;\n"
+			"	for (uint j = lid; j < num_bins; j += n) bins[j] = 0;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			: "	global uint *bins = counts;\n") +
+			"	for (unsigned long i = get_global_id(0); i < size; i += get_global_size(0)) {\n"
+			+ bin_code +
+			"	}\n" +
+			(privatized ?
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (uint j = lid; j < num_bins; j += n) {\n"
+			"		if (bins[j] > 0) atomic_add(&counts[j], bins[j]);\n"
+			"	}\n"
+			: "") +
+			"}";
+		return cl.get_kernel(kernel_code, "opencl_histogram");
+	}
+	
+	// counts the elements of aa falling in each of num_bins equal bins spanning [lo, hi] (values outside are
+	// ignored, hi goes in the last bin), or with integer bins 0 to num_bins - 1 when bincount is set; each
+	// work-group counts into a private histogram in local memory, when it fits, and adds it to counts when done
+	template<typename T>
+	void parallel_histogram(const cl::Buffer & aa, cl::Buffer & counts, size_type num_bins, bool bincount, T lo, T hi, size_type size) {
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to count";
+		cl::Kernel kernel = histogram_kernel<T>(bincount, true);
+		const bool privatized = cl.fits_local_memory(kernel, num_bins * sizeof(cl_uint));
+		if (!privatized) kernel = histogram_kernel<T>(bincount, false);
+		if (size == 0) return;
+		
+		const char *T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("histogram", &T_str, 1, bincount));
+		const size_type local_size = cl.work_group_size(kernel, config.local_size ? config.local_size : 256);
+		const size_type num_groups = std::min((size + local_size - 1) / local_size, (size_type)cl.get_compute_units() * 4);
+		cl.enqueue_kernel(kernel, num_groups * local_size, local_size, aa, counts, cl::Local((privatized ? num_bins : 1) * sizeof(cl_uint)),
+		                  (cl_uint)num_bins, lo, hi, (cl_ulong)size);
+	}
+	
+	// exclusive prefix sum of the elements of in (of whether they are nonzero when flags is set) written to
+	// out as uints; each work-group scans its block in local memory, the block totals are scanned
+	// recursively and added back, and the returned one-element buffer holds the overall total
+	template<typename T>
+	cl::Buffer parallel_scan(const cl::Buffer & in, cl::Buffer & out, size_type size, bool flags) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to scan";
+		const std::string value = flags ? "(in[i] != 0)" : "in[i]";
+		const std::string scan_code =
+			std::string("__kernel void opencl_scan(global ") + T_str + " *in, global uint *out, global uint *block_sums, local uint *temp, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0), lid = get_local_id(0), block_size = get_local_size(0);\n"
+			"	const uint v = i < size ? (uint)" + value + " : 0;\n"
+			"	temp[lid] = v;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (size_t offset = 1; offset < block_size; offset <<= 1) {\n"
+			"		const uint t = lid >= offset ? temp[lid - offset] : 0;\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		temp[lid] += t;\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	}\n"
+			"	if (i < size) out[i] = temp[lid] - v;\n"
+			"	if (lid == block_size - 1) block_sums[get_group_id(0)] = temp[lid];\n"
+			"}";
+		static const char* const add_code =
+			"__kernel void opencl_scan_add(global uint *out, global uint *offsets, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i < size) out[i] += offsets[get_group_id(0)];\n"
+			"}";
+		cl::Kernel scan_kernel = cl.get_kernel(scan_code, "opencl_scan");
+		if (size == 0) return cl.GPU_buffer<cl_uint>(1, 0);
+		
+		const launch_config config = cl.get_tuning(tuning_key("scan", &T_str, 1, -1));
+		const size_type local_size = cl.work_group_size(scan_kernel, config.local_size ? config.local_size : 256);
+		const size_type num_blocks = (size + local_size - 1) / local_size;
+		cl::Buffer block_sums = cl.GPU_buffer<cl_uint>(num_blocks);
+		cl.enqueue_kernel(scan_kernel, num_blocks * local_size, local_size, in, out, block_sums, cl::Local(local_size * sizeof(cl_uint)), (cl_ulong)size);
+		if (num_blocks == 1) return block_sums;
+		
+		cl::Buffer block_offsets = cl.GPU_buffer<cl_uint>(num_blocks);
+		cl::Buffer total = parallel_scan<cl_uint>(block_sums, block_offsets, num_blocks, false);
+		cl.enqueue_kernel(cl.get_kernel(add_code, "opencl_scan_add"), num_blocks * local_size, local_size, out, block_offsets, (cl_ulong)size);
+		return total;
+	}
+	
+	// kernel code of the function combining two values of a segmented reduction, and its identity
+	template<typename T>
+	std::string segment_combine_code(enum aggregate_kind op, T & identity) {
+		const std::string T_s = typeToStr<T>();
+		std::string combine;
+		switch (op) {
+			case aggregate_sum: case aggregate_count: combine = "a + b"; identity = T(0); break;
+			case aggregate_min: combine = "min(a, b)"; identity = std::numeric_limits<T>::max(); break;
+			case aggregate_max: combine = "max(a, b)"; identity = std::numeric_limits<T>::lowest(); break;
+			default: throw "segmented reductions support sum, count, min or max";
+		}
+		return T_s + " combine(const " + T_s + " a, const " + T_s + " b) {return " + combine + ";}\n";
+	}
+	
+	// inclusive scan of in with op, restarting wherever flags is set (counting ones instead of in for
+	// aggregate_count); each work-group scans its block in local memory, the block results are scanned
+	// recursively and carried into the elements before the first segment start of each block
+	template<typename T>
+	void parallel_segmented_scan(const cl::Buffer & in, const cl::Buffer & flags, cl::Buffer & out, size_type size, enum aggregate_kind op) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		T identity;
+		const std::string combine_code = segment_combine_code<T>(op, identity);
+		const std::string value = op == aggregate_count ? std::string("(") + T_str + ")1" : "in[i]";
+		const std::string scan_code = combine_code +
+			"__kernel void opencl_segmented_scan(global " + T_str + " *in, global uint *flags, global " + T_str + " *out, global uint *prefix_flags, "
+			"global " + T_str + " *block_values, global uint *block_flags, local " + T_str + " *values, local uint *heads, "
+			"const " + T_str + " identity, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0), lid = get_local_id(0), block_size = get_local_size(0);\n"
+			"	values[lid] = i < size ? " + value + " : identity;\n"
+			"	heads[lid] = i < size ? flags[i] != 0 : 0;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (size_t offset = 1; offset < block_size; offset <<= 1) {\n"
+			"		" + T_str + " previous = identity;\n"
+			"		uint previous_head = 0;\n"
+			"		if (lid >= offset) {\n"
+			"			previous = values[lid - offset];\n"
+			"			previous_head = heads[lid - offset];\n"
+			"		}\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		if (lid >= offset) {\n"
+			"			if (!heads[lid]) values[lid] = combine(previous, values[lid]);\n"
+			"			heads[lid] |= previous_head;\n"
+			"		}\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	}\n"
+			"	if (i < size) {\n"
+			"		out[i] = values[lid];\n"
+			"		prefix_flags[i] = heads[lid];\n"
+			"	}\n"
+			"	if (lid == block_size - 1) {\n"
+			"		block_values[get_group_id(0)] = values[lid];\n"
+			"		block_flags[get_group_id(0)] = heads[lid];\n"
+			"	}\n"
+			"}";
+		const std::string add_code = combine_code +
+			"__kernel void opencl_segmented_scan_add(global " + T_str + " *out, global uint *prefix_flags, global " + T_str + " *block_scanned, "
+			"const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0), group = get_group_id(0);\n"
+			"	if (i < size && group > 0 && !prefix_flags[i]) out[i] = combine(block_scanned[group - 1], out[i]);\n"
+			"}";
+		cl::Kernel scan_kernel = cl.get_kernel(scan_code, "opencl_segmented_scan");
+		if (size == 0) return;
+		
+		const launch_config config = cl.get_tuning(tuning_key("segmented_scan", &T_str, 1, op));
+		const size_type local_size = cl.work_group_size(scan_kernel, config.local_size ? config.local_size : 256);
+		const size_type num_blocks = (size + local_size - 1) / local_size;
+		cl::Buffer prefix_flags = cl.GPU_buffer<cl_uint>(size);
+		cl::Buffer block_values = cl.GPU_buffer<T>(num_blocks), block_flags = cl.GPU_buffer<cl_uint>(num_blocks);
+		cl.enqueue_kernel(scan_kernel, num_blocks * local_size, local_size, in, flags, out, prefix_flags, block_values, block_flags,
+		                  cl::Local(local_size * sizeof(T)), cl::Local(local_size * sizeof(cl_uint)), identity, (cl_ulong)size);
+		if (num_blocks == 1) return;
+		
+		// the block results are combined, not counted, at the next level
+		cl::Buffer block_scanned = cl.GPU_buffer<T>(num_blocks);
+		parallel_segmented_scan<T>(block_values, block_flags, block_scanned, num_blocks, op == aggregate_count ? aggregate_sum : op);
+		cl.enqueue_kernel(cl.get_kernel(add_code, "opencl_segmented_scan_add"), num_blocks * local_size, local_size, out, prefix_flags,
+		                  block_scanned, (cl_ulong)size);
+	}
+	
+	// writes the elements of up to four columns whose mask is set to the positions given by the exclusive
+	// scan of the mask, so rows stay aligned and in their original order
+	template<typename T>
+	void parallel_compact(const cl::Buffer & mask, const cl::Buffer & positions, const std::vector<cl::Buffer> & ins,
+	                      std::vector<cl::Buffer> & outs, size_type size) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		const unsigned num_columns = ins.size();
+		if (num_columns == 0 || num_columns > 4 || outs.size() != num_columns) throw "can only compact one to four columns at once";
+		std::string params, body;
+		for (unsigned k = 0; k < num_columns; ++k) {
+			const std::string n = std::to_string(k);
+			params += std::string("global ") + T_str + " *in" + n + ", global " + T_str + " *out" + n + ", ";
+			body += "		out" + n + "[position] = in" + n + "[i];\n";
+		}
+		const std::string kernel_code =
+			"__kernel void opencl_compact(global bool *mask, global uint *positions, " + params + "const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i < size && mask[i]) {\n"
+			"		const uint position = positions[i];\n" + body +
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_compact");
+		if (size == 0) return;
+		
+		const launch_config config = cl.get_tuning(tuning_key("compact", &T_str, 1, num_columns));
+		switch (num_columns) {
+			case 1: cl.enqueue_kernel(kernel, size, config.local_size, mask, positions, ins[0], outs[0], (cl_ulong)size); break;
+			case 2: cl.enqueue_kernel(kernel, size, config.local_size, mask, positions, ins[0], outs[0], ins[1], outs[1], (cl_ulong)size); break;
+			case 3: cl.enqueue_kernel(kernel, size, config.local_size, mask, positions, ins[0], outs[0], ins[1], outs[1], ins[2], outs[2], (cl_ulong)size); break;
+			default: cl.enqueue_kernel(kernel, size, config.local_size, mask, positions, ins[0], outs[0], ins[1], outs[1], ins[2], outs[2], ins[3], outs[3], (cl_ulong)size); break;
+		}
+	}
+	
+	// stable two-way partition: elements whose mask is set go to selected at the positions given by the
+	// exclusive scan of the mask, the rest go to rejected, both in one pass over the input
+	template<typename T>
+	void parallel_partition(const cl::Buffer & mask, const cl::Buffer & positions, const cl::Buffer & in,
+	                        cl::Buffer & selected, cl::Buffer & rejected, size_type size) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		const std::string kernel_code =
+			std::string("__kernel void opencl_partition(global bool *mask, global uint *positions, global ") + T_str + " *in, "
+			"global " + T_str + " *selected, global " + T_str + " *rejected, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i >= size) return;\n"
+			"	const uint position = positions[i];\n"
+			"	if (mask[i]) selected[position] = in[i];\n"
+			"	else rejected[i - position] = in[i];\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_partition");
+		if (size == 0) return;
+		
+		const launch_config config = cl.get_tuning(tuning_key("partition", &T_str, 1, -1));
+		cl.enqueue_kernel(kernel, size, config.local_size, mask, positions, in, selected, rejected, (cl_ulong)size);
+	}
+	
+	// aggregates of one column, the ones not requested are left at 0; min and max of an empty selection
+	// are the largest and lowest values of T
+	template<typename T>
+	struct aggregate_result {
+		aggregate_result() : sum(0), count(0), min(std::numeric_limits<T>::max()), max(std::numeric_limits<T>::lowest()), sum_of_squares(0) {};
+		T sum;
+		size_type count;
+		T min;
+		T max;
+		T sum_of_squares;
+	};
+	
+	// kernel code reducing value across the work-group through scratch with combine (of scratch[lid] and
+	// scratch[lid + s]), work-item 0 writing the result to destination
+	static std::string group_reduce_code(const std::string & value, const std::string & combine, const std::string & destination) {
+		return
+			"	scratch[lid] = " + value + ";\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (size_t s = 1; s < n; s <<= 1) {\n"
+			"		if ((lid & (2 * s - 1)) == 0 && lid + s < n) scratch[lid] = " + combine + ";\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	}\n"
+			"	if (lid == 0) " + destination + " = scratch[0];\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n";
+	}
+	
+	// computes the requested aggregates of up to four columns (over the rows where mask is set, if masked)
+	// in a single traversal; each work-group reduces its rows in local memory and the per-group partial
+	// results are combined into results on the host
+	template<typename T>
+	void parallel_aggregate(const std::vector<cl::Buffer> & ins, const cl::Buffer * mask, int kinds, size_type size,
+	                        std::vector<aggregate_result<T>> & results) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		if (size >= 0xFFFFFFFFul) throw "Vector too large to count";
+		const unsigned num_columns = ins.size();
+		if (num_columns == 0 || num_columns > 4) throw "can only aggregate one to four columns at once";
+		static const char* const names[] = {"sum", "min", "max", "sq"};
+		static const int flags[] = {aggregate_sum, aggregate_min, aggregate_max, aggregate_sum_of_squares};
+		static const char* const combines[] = {"scratch[lid] + scratch[lid + s]", "min(scratch[lid], scratch[lid + s])",
+		                                       "max(scratch[lid], scratch[lid + s])", "scratch[lid] + scratch[lid + s]"};
+		std::string params, init, accumulate, reduce;
+		for (unsigned k = 0; k < num_columns; ++k) {
+			const std::string n = std::to_string(k);
+			params += std::string("global ") + T_str + " *in" + n + ", ";
+			accumulate += std::string("			const ") + T_str + " v" + n + " = in" + n + "[i];\n";
+			for (unsigned a = 0; a < 4; ++a) {
+				if (!(kinds & flags[a])) continue;
+				const std::string var = names[a] + n;
+				const char* initial = a == 1 ? "min_init" : a == 2 ? "max_init" : "0";
+				init += std::string("	") + T_str + " " + var + " = " + initial + ";\n";
+				if (a == 0) accumulate += "			" + var + " += v" + n + ";\n";
+				if (a == 1) accumulate += "			" + var + " = min(" + var + ", v" + n + ");\n";
+				if (a == 2) accumulate += "			" + var + " = max(" + var + ", v" + n + ");\n";
+				if (a == 3) accumulate += "			" + var + " += v" + n + " * v" + n + ";\n";
+				reduce += group_reduce_code(var, combines[a], "partials[" + std::to_string(k * 4 + a) + " * get_num_groups(0) + get_group_id(0)]");
+			}
+		}
+		const std::string kernel_code =
+			"__kernel void opencl_aggregate(" + params + "global bool *mask, global " + T_str + " *partials, global uint *counts, "
+			"local " + T_str + " *scratch, local uint *count_scratch, const " + T_str + " min_init, const " + T_str + " max_init, "
+			"const unsigned long size) \n"
+			"{\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0);\n"
+			+ init +
+			"	uint count = 0;\n"
+			"	for (unsigned long i = get_global_id(0); i < size; i += get_global_size(0)) {\n"
+			"		if (" + (mask ? "mask[i]" : "true") + ") {\n"
+			+ accumulate +
+			"			++count;\n"
+			"		}\n"
+			"	}\n"
+			+ reduce +
+			"	count_scratch[lid] = count;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (size_t s = 1; s < n; s <<= 1) {\n"
+			"		if ((lid & (2 * s - 1)) == 0 && lid + s < n) count_scratch[lid] += count_scratch[lid + s];\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	}\n"
+			"	if (lid == 0) counts[get_group_id(0)] = count_scratch[0];\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_aggregate");
+		results.assign(num_columns, aggregate_result<T>());
+		if (size == 0) return;
+		
+		const launch_config config = cl.get_tuning(tuning_key("aggregate", &T_str, 1, kinds));
+		const size_type local_size = cl.work_group_size(kernel, config.local_size ? config.local_size : 256);
+		const size_type num_groups = std::min((size + local_size - 1) / local_size, (size_type)cl.get_compute_units() * 4);
+		cl::Buffer partials = cl.GPU_buffer<T>(num_columns * 4 * num_groups);
+		cl::Buffer counts = cl.GPU_buffer<cl_uint>(num_groups);
+		// without a mask the first column is passed in its place and never read
+		const cl::Buffer & mask_arg = mask ? *mask : ins[0];
+		const cl::LocalSpaceArg scratch = cl::Local(local_size * sizeof(T)), count_scratch = cl::Local(local_size * sizeof(cl_uint));
+		const T min_init = std::numeric_limits<T>::max(), max_init = std::numeric_limits<T>::lowest();
+		const size_type global_size = num_groups * local_size;
+		switch (num_columns) {
+			case 1: cl.enqueue_kernel(kernel, global_size, local_size, ins[0], mask_arg, partials, counts, scratch, count_scratch, min_init, max_init, (cl_ulong)size); break;
+			case 2: cl.enqueue_kernel(kernel, global_size, local_size, ins[0], ins[1], mask_arg, partials, counts, scratch, count_scratch, min_init, max_init, (cl_ulong)size); break;
+			case 3: cl.enqueue_kernel(kernel, global_size, local_size, ins[0], ins[1], ins[2], mask_arg, partials, counts, scratch, count_scratch, min_init, max_init, (cl_ulong)size); break;
+			default: cl.enqueue_kernel(kernel, global_size, local_size, ins[0], ins[1], ins[2], ins[3], mask_arg, partials, counts, scratch, count_scratch, min_init, max_init, (cl_ulong)size); break;
+		}
+		
+		std::vector<T> partial_results(num_columns * 4 * num_groups);
+		std::vector<cl_uint> partial_counts(num_groups);
+		cl.from_GPU_buffer(partials, 0, partial_results);
+		cl.from_GPU_buffer(counts, 0, partial_counts);
+		size_type count = 0;
+		for (size_type g = 0; g < num_groups; ++g) count += partial_counts[g];
+		for (unsigned k = 0; k < num_columns; ++k) {
+			aggregate_result<T> & result = results[k];
+			const T* column = &partial_results[k * 4 * num_groups];
+			if (kinds & aggregate_count) result.count = count;
+			for (size_type g = 0; g < num_groups; ++g) {
+				if (kinds & aggregate_sum) result.sum += column[g];
+				if (kinds & aggregate_min) result.min = std::min(result.min, column[num_groups + g]);
+				if (kinds & aggregate_max) result.max = std::max(result.max, column[2 * num_groups + g]);
+				if (kinds & aggregate_sum_of_squares) result.sum_of_squares += column[3 * num_groups + g];
+			}
+		}
+	}
+	
 	template<typename T>
 	void parallel_rotate(cl::Buffer & ins, const cl::Buffer & outs, long int rotation, size_type size) {
 		static const char* const starting_kernel_code =
-			"__kernel void opencl_rotate(__global %s *ins, __global %s *outs, __const long int rotation, __const size_t size) \n"
+			"__kernel void opencl_rotate(__global %s *ins, __global %s *outs, __const long rotation, __const unsigned long size) \n"
 			"{                                        \n"
 			"	const size_t i = get_global_id(0);   \n"
+			"	if (i >= size) return;               \n"
 			"	outs[(i+rotation) %s size] = ins[i]; \n"
 			"}";
-		static cl::Program program;
-		static cl::Kernel kernel;
-		static bool initialized;
-		cl_int err = CL_SUCCESS;
-		if (!initialized) {
-			const char *T_str = typeToStr<T>();
-			if (T_str == nullptr) throw "Unsupported type in computation";
-			char kernel_code[1000];
-			sprintf(kernel_code, starting_kernel_code, T_str, T_str, "%");
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
-			}
-			kernel = cl::Kernel(program, "opencl_rotate");
-			initialized = true;
-		}
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		char kernel_code[1000];
+		sprintf(kernel_code, starting_kernel_code, T_str, T_str, "%");
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_rotate");
+		if (size == 0) return;
 		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		cl::Event event = (cl::make_kernel<cl::Buffer, cl::Buffer, const long int, const size_t>(kernel))(cl::EnqueueArgs(queue, cl::NDRange(size)), ins, outs, rotation, size);
-		event.wait();
+		const launch_config config = cl.get_tuning(tuning_key("rotate", &T_str, 1, -1));
+		cl.enqueue_kernel(kernel, size, config.local_size, ins, outs, (cl_long)rotation, (cl_ulong)size);
 	}
 	
 	template<typename T>
 	void parallel_indices(cl::Buffer & buf, size_type size) {
 		static const char* const starting_kernel_code =
-			"__kernel void opencl_indices(__global %s *buf) \n"
+			"__kernel void opencl_indices(__global %s *buf, __const unsigned long size) \n"
 			"{                                        \n"
 			"	const size_t i = get_global_id(0);   \n"
-			"	buf[i] = i;                          \n"
+			"	if (i < size) buf[i] = i;            \n"
 			"}";
-		static cl::Program program;
-		static cl::Kernel kernel;
-		static bool initialized;
-		cl_int err = CL_SUCCESS;
-		if (!initialized) {
-			const char *T_str = typeToStr<T>();
-			if (T_str == nullptr) throw "Unsupported type in computation";
-			char kernel_code[500];
-			sprintf(kernel_code, starting_kernel_code, T_str);
-			try {
-				cl::Program::Sources kernel_source(1, std::make_pair(kernel_code,strlen(kernel_code)));
-				program = cl::Program(cl.get_GPU_context(), std::string(kernel_code), true);
-			} catch (cl::Error & err) {
-				throw "Error encountered during OpenCL compilation";
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		char kernel_code[500];
+		sprintf(kernel_code, starting_kernel_code, T_str);
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_indices");
+		if (size == 0) return;
+		
+		const launch_config config = cl.get_tuning(tuning_key("indices", &T_str, 1, -1));
+		cl.enqueue_kernel(kernel, size, config.local_size, buf, (cl_ulong)size);
+	}
+	
+	// a single value kept in a one-element device buffer, such as a reduction result, that later kernels
+	// read directly so the host only waits for it when get() is called; scalars are never modified in place
+	template<typename T>
+	class Scalar {
+		public:
+			Scalar() : initialized(false) {};
+			explicit Scalar(T value) : data(cl.GPU_buffer<T>(1, value)), initialized(true) {};
+			
+			// host reads
+			T get() {
+				if (!initialized) throw "Scalar not initialized";
+				return cl.get_GPU_buffer_index<T>(data, 0);
+			}
+			Future<T> get_async() {
+				if (!initialized) throw "Scalar not initialized";
+				return async_read<T, T>(data, 0, 1, T(), [](T & value, const T * element) { value = element[0]; });
+			}
+			
+			// arithmetic on the device
+			Scalar operator+ (const Scalar& scalar) {
+				return compute<T>(scalar, plus);
+			}
+			Scalar operator- (const Scalar& scalar) {
+				return compute<T>(scalar, minus);
+			}
+			Scalar operator* (const Scalar& scalar) {
+				return compute<T>(scalar, times);
+			}
+			Scalar operator/ (const Scalar& scalar) {
+				return compute<T>(scalar, divide);
+			}
+			// comparisons on the device, e.g. for convergence checks in PV::loop_until
+			Scalar<bool> operator== (const Scalar& scalar) {
+				return compute<bool>(scalar, equals);
+			}
+			Scalar<bool> operator!= (const Scalar& scalar) {
+				return compute<bool>(scalar, not_equals);
+			}
+			Scalar<bool> operator> (const Scalar& scalar) {
+				return compute<bool>(scalar, greater);
+			}
+			Scalar<bool> operator< (const Scalar& scalar) {
+				return compute<bool>(scalar, lesser);
+			}
+			Scalar<bool> operator>= (const Scalar& scalar) {
+				return compute<bool>(scalar, greater_equal);
+			}
+			Scalar<bool> operator<= (const Scalar& scalar) {
+				return compute<bool>(scalar, lesser_equal);
+			}
+			
+			cl::Buffer data;
+		private:
+			explicit Scalar(cl::Buffer buffer) : data(buffer), initialized(true) {};
+			
+			template<typename R>
+			Scalar<R> compute(const Scalar& scalar, enum operation op) {
+				if (!initialized || !scalar.initialized) throw "Scalar not initialized";
+				Scalar<R> output(cl.GPU_buffer<R>(1));
+				parallel_compute<T, T, R>(data, scalar.data, output.data, 1, op);
+				return output;
+			}
+			
+			bool initialized;
+			template<typename U>
+			friend class Scalar;
+			template<typename U>
+			friend class Vector;
+	};
+	
+	template<class T>
+	class Vector;
+	
+	// an elementwise operation on two Vectors of type T producing R, evaluated by Vector<R>::assign();
+	// it only refers to its operands, so it has to be assigned within the expression that creates it
+	template<typename T, typename R>
+	struct pending_operation {
+		pending_operation(const Vector<T> & a, const Vector<T> & b, enum operation op) : a(a), b(b), op(op) {};
+		const Vector<T> & a;
+		const Vector<T> & b;
+		enum operation op;
+	};
+	
+	// runs body, which reassigns converged, until converged is true on the device or max_iterations have run,
+	// and returns the number of iterations run; the check of each iteration is read back asynchronously while
+	// up to depth further iterations are enqueued, so a few extra iterations may run after convergence
+	template<class body_type>
+	size_type loop_until(Scalar<bool> & converged, size_type max_iterations, body_type body, size_type depth = 4) {
+		std::deque<Future<bool>> checks;
+		size_type iteration = 0;
+		while (iteration < max_iterations) {
+			body();
+			++iteration;
+			checks.push_back(converged.get_async());
+			// only wait for the oldest check once the pipeline is full
+			while (!checks.empty() && (checks.size() > depth || checks.front().ready())) {
+				if (checks.front().get()) return iteration;
+				checks.pop_front();
 			}
-			kernel = cl::Kernel(program, "opencl_indices");
-			initialized = true;
 		}
-		
-		cl::CommandQueue queue = cl.get_GPU_queue();
-		cl::Event event = (cl::make_kernel<cl::Buffer>(kernel))(cl::EnqueueArgs(queue, cl::NDRange(size)), buf);
-		event.wait();
+		return iteration;
 	}
 	
 	template<class T>
@@ -592,40 +2187,50 @@ namespace PV {
 		public:
 			// CONSTRUCTORS
 			// default constructor
-			Vector() : num_filled(0), num_allocated(0), initialized(false) {};
+			Vector() : host_data(nullptr), num_filled(0), num_allocated(0), initialized(false) {};
 			
 			// fill constructors
-			explicit Vector(size_type length) : data(cl.GPU_buffer<T>(length)), num_filled(length), num_allocated(length), initialized(true) {};
-			explicit Vector(size_type length, T fill_value) : data(cl.GPU_buffer<T>(length, fill_value)), num_filled(length), num_allocated(length), initialized(true) {};
+			explicit Vector(size_type length) : host_data(nullptr), data(cl.GPU_storage<T>(length, host_data)), num_filled(length), num_allocated(length), initialized(true), owners(std::make_shared<bool>(true)) {};
+			explicit Vector(size_type length, T fill_value) : host_data(nullptr), data(cl.GPU_storage<T>(length, fill_value, host_data)), num_filled(length), num_allocated(length), initialized(true), owners(std::make_shared<bool>(true)) {};
+			// filled with the current value of param, also on every launch of a graph it is captured in
+			explicit Vector(size_type length, const graph_param<T> & param) : host_data(nullptr), data(cl.GPU_storage<T>(length, std::shared_ptr<const T>(param.value), host_data)), num_filled(length), num_allocated(length), initialized(true), owners(std::make_shared<bool>(true)) {};
 			
 			// range constructors
 			template<class input_iterator_type>
 			//typedef typename std::iterator<std::input_iterator_tag, T> input_iterator_type;
-			Vector(input_iterator_type begin, input_iterator_type end) : data(cl.GPU_buffer_iter(begin, end)), num_filled(end-begin), num_allocated(end-begin), initialized(true) {};
-			Vector(T* data_in, size_type length) : data(cl.GPU_buffer(data_in, length)), num_filled(length), num_allocated(length), initialized(true) {};
+			Vector(input_iterator_type begin, input_iterator_type end) : host_data(nullptr), data(cl.GPU_storage_iter(begin, end, host_data)), num_filled(end-begin), num_allocated(end-begin), initialized(true), owners(std::make_shared<bool>(true)) {};
+			Vector(T* data_in, size_type length) : host_data(nullptr), data(cl.GPU_storage(data_in, length, host_data)), num_filled(length), num_allocated(length), initialized(true), owners(std::make_shared<bool>(true)) {};
 			
-			// copy constructors
-			Vector(const Vector& vec) {
+			// copy constructors, the copy shares the buffer until either Vector is written
+			Vector(const Vector& vec) : host_data(nullptr) {
 				initialized = vec.initialized;
-				if (vec.initialized) {
-					data = cl.duplicate_buffer<T>(vec.data, vec.num_filled, vec.num_allocated);
-					num_filled = vec.num_filled;
-					num_allocated = vec.num_allocated;
-				}
+				if (vec.initialized) share(vec);
 			};
-			Vector(const std::vector<T>& vec) : data(cl.GPU_buffer_iter(vec.begin(), vec.end())), num_filled(vec.size()), num_allocated(vec.size()), initialized(true) {};
+			Vector(const std::vector<T>& vec) : host_data(nullptr), data(cl.GPU_storage_iter(vec.begin(), vec.end(), host_data)), num_filled(vec.size()), num_allocated(vec.size()), initialized(true), owners(std::make_shared<bool>(true)) {};
 			
-			// move constructor
-			Vector(const Vector&& vec) : data(cl.move_buffer<T>(vec.data)), num_filled(vec.num_filled), num_allocated(vec.num_allocated), initialized(vec.initialized) {};
+			// move constructor, vec is left uninitialized
+			Vector(Vector&& vec) : host_data(vec.host_data), data(cl.move_buffer<T>(vec.data)), num_filled(vec.num_filled), num_allocated(vec.num_allocated), initialized(vec.initialized), owners(std::move(vec.owners)), shared_at(std::move(vec.shared_at)) {
+				vec.release();
+			};
 			
 			// copy assignment
 			Vector<T> & operator=(const Vector<T>& vec) {
 				initialized = vec.initialized;
-				if (vec.initialized) {
-					data = cl.duplicate_buffer<T>(vec.data, vec.num_filled, vec.num_allocated);
-					num_filled = vec.num_filled;
-					num_allocated = vec.num_allocated;
-				}
+				if (vec.initialized) share(vec);
+				return get_this();
+			};
+			
+			// move assignment, takes over the buffer of vec without copying
+			Vector<T> & operator=(Vector<T>&& vec) {
+				if (this == &vec) return get_this();
+				host_data = vec.host_data;
+				data = cl.move_buffer<T>(vec.data);
+				num_filled = vec.num_filled;
+				num_allocated = vec.num_allocated;
+				initialized = vec.initialized;
+				owners = std::move(vec.owners);
+				shared_at = std::move(vec.shared_at);
+				vec.release();
 				return get_this();
 			};
 			
@@ -634,93 +2239,188 @@ namespace PV {
 			// accessor
 			T operator[] (size_type index) {
 				if (!initialized) throw "Vector not initialized";
+				if (host_data) return host_access()[index];
 				return cl.get_GPU_buffer_index<T>(data, index);
 			}
 			// getters
 			T get(size_type index) {
 				if (!initialized) throw "Vector not initialized";
 				if (index < num_filled) {
+					if (host_data) return host_access()[index];
 					return cl.get_GPU_buffer_index<T>(data, index);
 				} else throw "index out of range";
 			}
+			Future<T> get_async(size_type index) {
+				if (!initialized) throw "Vector not initialized";
+				if (index >= num_filled) throw "index out of range";
+				return async_read<T, T>(data, index, 1, T(), [](T & value, const T * element) { value = element[0]; });
+			}
 			void get(size_type start_index, T* data_in, size_type length) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + length > num_filled) throw  "cannot get indices beyond end of Vector";
-				cl.from_GPU_buffer(data, start_index, data_in, length);
+				if (host_data) std::copy(host_access() + start_index, host_data + start_index + length, data_in);
+				else cl.from_GPU_buffer(data, start_index, data_in, length);
 			}
 			void get(size_type start_index, std::vector<T> & vec) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + vec.size() > num_filled) throw  "cannot get indices beyond end of Vector";
-				cl.from_GPU_buffer(data, start_index, vec);
+				if (host_data) std::copy(host_access() + start_index, host_data + start_index + vec.size(), vec.begin());
+				else cl.from_GPU_buffer(data, start_index, vec);
 			}
 			template<class iterator_type>
 			void get(size_type start_index, iterator_type begin, iterator_type end) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + (end-begin) > num_filled) throw  "cannot get indices beyond end of Vector";
-				cl.from_GPU_buffer(data, start_index, begin, end);
+				if (host_data) std::copy(host_access() + start_index, host_data + start_index + (end-begin), begin);
+				else cl.from_GPU_buffer(data, start_index, begin, end);
 			}
 			// setters
 			void set(size_type index, T val) {
 				if (!initialized) throw "Vector not initialized";
 				if (index < num_filled) {
-					cl.set_GPU_buffer_index<T>(data, index, val);
+					detach();
+					if (host_data) host_access()[index] = val;
+					else cl.set_GPU_buffer_index<T>(data, index, val);
 				} else throw "index out of range";
 			}
 			void set(size_type start_index, T* data_in, size_type length) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + length > num_filled) throw  "cannot set indices beyond end of Vector";
-				cl.to_GPU_buffer(data, start_index, data_in, length);
+				detach();
+				if (host_data) std::copy(data_in, data_in + length, host_access() + start_index);
+				else cl.to_GPU_buffer(data, start_index, data_in, length);
 			}
 			void set(size_type start_index, std::vector<T> & vec) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + vec.size() > num_filled) throw  "cannot set indices beyond end of Vector";
-				cl.to_GPU_buffer(data, start_index, vec);
+				detach();
+				if (host_data) std::copy(vec.begin(), vec.end(), host_access() + start_index);
+				else cl.to_GPU_buffer(data, start_index, vec);
 			}
 			template<class iterator_type>
 			void set(size_type start_index, iterator_type begin, iterator_type end) {
 				if (!initialized) throw "Vector not initialized";
 				if (start_index + (end-begin) > num_filled) throw  "cannot set indices beyond end of Vector";
-				cl.to_GPU_buffer(data, start_index, begin, end);
+				detach();
+				if (host_data) std::copy(begin, end, host_access() + start_index);
+				else cl.to_GPU_buffer(data, start_index, begin, end);
+			}
+			// evaluate into this Vector's buffer, which must already have the operands' size
+			template<typename U>
+			Vector<T> & assign(const pending_operation<U, T> & operation) {
+				do_operation<U,U,T>(operation.a, operation.b, get_this(), operation.op);
+				return get_this();
+			}
+			Vector<T> & assign(const Vector<T> & vec) {
+				if (!initialized || !vec.initialized) throw "Vector not initialized";
+				if (size() != vec.size()) throw "Vector size mismatch";
+				if (&vec == this) return get_this();
+				detach();
+				cl.copy_buffer<T>(vec.data, data, size());
+				return get_this();
+			}
+			
+			// true if the Vector lives in shared virtual memory and host accesses are plain loads and stores
+			bool is_shared() const {
+				return host_data != nullptr;
 			}
 			
 			
 			// arithmetic operators
 			// plus
-			Vector operator+ (const Vector& vec) {
+			Vector operator+ (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, plus);
 				return output;
 			}
+			Vector operator+ (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, plus);
+			}
+			Vector operator+ (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, plus);
+			}
 			// minus
-			Vector operator- (const Vector& vec) {
+			Vector operator- (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, minus);
 				return output;
 			}
+			Vector operator- (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, minus);
+			}
+			Vector operator- (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, minus);
+			}
 			// times
-			Vector operator* (const Vector& vec) {
+			Vector operator* (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, times);
 				return output;
 			}
+			Vector operator* (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, times);
+			}
+			Vector operator* (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, times);
+			}
 			// divide
-			Vector operator/ (const Vector& vec) {
+			Vector operator/ (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, divide);
 				return output;
 			}
+			Vector operator/ (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, divide);
+			}
+			Vector operator/ (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, divide);
+			}
 			// mod
-			Vector operator% (const Vector& vec) {
+			Vector operator% (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, mod);
 				return output;
 			}
+			Vector operator% (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, mod);
+			}
+			Vector operator% (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, mod);
+			}
+			// with a device scalar, whose value is used for every element
+			Vector operator+ (const Scalar<T>& scalar) & {
+				return scalar_operation(scalar, plus);
+			}
+			Vector operator+ (const Scalar<T>& scalar) && {
+				return scalar_operation(scalar, plus, true);
+			}
+			Vector operator- (const Scalar<T>& scalar) & {
+				return scalar_operation(scalar, minus);
+			}
+			Vector operator- (const Scalar<T>& scalar) && {
+				return scalar_operation(scalar, minus, true);
+			}
+			Vector operator* (const Scalar<T>& scalar) & {
+				return scalar_operation(scalar, times);
+			}
+			Vector operator* (const Scalar<T>& scalar) && {
+				return scalar_operation(scalar, times, true);
+			}
+			Vector operator/ (const Scalar<T>& scalar) & {
+				return scalar_operation(scalar, divide);
+			}
+			Vector operator/ (const Scalar<T>& scalar) && {
+				return scalar_operation(scalar, divide, true);
+			}
 			// negate
-			Vector operator- () {
+			Vector operator- () & {
 				Vector<T> output(size());
 				do_operation<T,T>(get_this(), output, negate);
 				return output;
 			}
+			Vector operator- () && {
+				return operation_into(get_this(), negate);
+			}
 			// prefix increment
 			void operator++ () {
 				do_operation<T,T>(get_this(), get_this(), increment);
@@ -822,57 +2522,90 @@ namespace PV {
 			
 			// bitwise operators
 			// and
-			Vector operator& (const Vector& vec) {
+			Vector operator& (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, bitwise_and);
 				return output;
 			}
+			Vector operator& (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, bitwise_and);
+			}
+			Vector operator& (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, bitwise_and);
+			}
 			// and equals
 			void operator&= (const Vector& vec) {
 				do_operation<T,T,T>(get_this(), vec, get_this(), bitwise_and);
 			}
 			// or
-			Vector operator| (const Vector& vec) {
+			Vector operator| (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, bitwise_or);
 				return output;
 			}
+			Vector operator| (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, bitwise_or);
+			}
+			Vector operator| (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, bitwise_or);
+			}
 			// or equals
 			void operator|= (const Vector& vec) {
 				do_operation<T,T,T>(get_this(), vec, get_this(), bitwise_or);
 			}
 			// xor
-			Vector operator^ (const Vector& vec) {
+			Vector operator^ (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, bitwise_xor);
 				return output;
 			}
+			Vector operator^ (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, bitwise_xor);
+			}
+			Vector operator^ (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, bitwise_xor);
+			}
 			// xor equals
 			void operator^= (const Vector& vec) {
 				do_operation<T,T,T>(get_this(), vec, get_this(), bitwise_xor);
 			}
 			// not
-			Vector operator~ () {
+			Vector operator~ () & {
 				Vector<T> output(size());
 				do_operation<T,T>(get_this(), output, bitwise_not);
 				return output;
 			}
+			Vector operator~ () && {
+				return operation_into(get_this(), bitwise_not);
+			}
 			// shift left
-			Vector operator<< (const Vector& vec) {
+			Vector operator<< (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, left_shift);
 				return output;
 			}
+			Vector operator<< (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, left_shift);
+			}
+			Vector operator<< (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, left_shift);
+			}
 			// shift left equals
 			void operator<<= (const Vector& vec) {
 				do_operation<T,T,T>(get_this(), vec, get_this(), left_shift);
 			}
 			// shift right
-			Vector operator>> (const Vector& vec) {
+			Vector operator>> (const Vector& vec) & {
 				Vector<T> output(size());
 				do_operation<T,T,T>(get_this(), vec, output, right_shift);
 				return output;
 			}
+			Vector operator>> (const Vector& vec) && {
+				return operation_into(get_this(), get_this(), vec, right_shift);
+			}
+			Vector operator>> (Vector&& vec) {
+				return operation_into(vec, get_this(), vec, right_shift);
+			}
 			// shift right equals
 			void operator>>= (const Vector& vec) {
 				do_operation<T,T,T>(get_this(), vec, get_this(), right_shift);
@@ -900,6 +2633,102 @@ namespace PV {
 				return parallel_reduce<T>(data, num_filled, reduce_times);
 			}
 			
+			// SEARCHES
+			// index of the first nonzero (true) element, or size() if there is none; stops early once found
+			size_type find_first() {
+				if (!initialized) throw "Vector not initialized";
+				return parallel_find<T>(data, nullptr, -1, true, num_filled);
+			}
+			bool any() {
+				return find_first() < size();
+			}
+			bool all() {
+				if (!initialized) throw "Vector not initialized";
+				return parallel_find<T>(data, nullptr, -1, false, num_filled) == num_filled;
+			}
+			// number of nonzero (true) elements
+			size_type count() {
+				if (!initialized) throw "Vector not initialized";
+				return parallel_count<T>(data, nullptr, -1, true, num_filled);
+			}
+			
+			// reductions whose result stays on the device
+			Scalar<T> sum_scalar() {
+				if (!initialized) throw "Vector not initialized";
+				return Scalar<T>(parallel_reduce_device<T>(data, num_filled, reduce_plus));
+			}
+			Scalar<T> product_scalar() {
+				if (!initialized) throw "Vector not initialized";
+				return Scalar<T>(parallel_reduce_device<T>(data, num_filled, reduce_times));
+			}
+			// reductions over the elements where vec is true, without compacting them first
+			T sum_where(const Vector<bool> & vec) {
+				T sum;
+				size_type count;
+				reduce_where<bool>(vec, vec, -1, sum, count);
+				return sum;
+			}
+			size_type count_where(const Vector<bool> & vec) {
+				T sum;
+				size_type count;
+				reduce_where<bool>(vec, vec, -1, sum, count);
+				return count;
+			}
+			T mean_where(const Vector<bool> & vec) {
+				T sum;
+				size_type count;
+				reduce_where<bool>(vec, vec, -1, sum, count);
+				if (count == 0) throw "Cannot take mean of empty selection";
+				return sum / (T)count;
+			}
+			Scalar<T> sum_where_scalar(const Vector<bool> & vec) {
+				return reduce_where_scalar<bool>(vec, vec, -1, false);
+			}
+			Scalar<T> mean_where_scalar(const Vector<bool> & vec) {
+				return reduce_where_scalar<bool>(vec, vec, -1, true);
+			}
+			// the same over the elements where a comparison holds, e.g. sum_where(PV::compare_lt(a, b))
+			template<typename U>
+			T sum_where(const pending_operation<U, bool> & predicate) {
+				T sum;
+				size_type count;
+				reduce_where<U>(predicate.a, predicate.b, predicate.op, sum, count);
+				return sum;
+			}
+			template<typename U>
+			size_type count_where(const pending_operation<U, bool> & predicate) {
+				T sum;
+				size_type count;
+				reduce_where<U>(predicate.a, predicate.b, predicate.op, sum, count);
+				return count;
+			}
+			template<typename U>
+			T mean_where(const pending_operation<U, bool> & predicate) {
+				T sum;
+				size_type count;
+				reduce_where<U>(predicate.a, predicate.b, predicate.op, sum, count);
+				if (count == 0) throw "Cannot take mean of empty selection";
+				return sum / (T)count;
+			}
+			template<typename U>
+			Scalar<T> sum_where_scalar(const pending_operation<U, bool> & predicate) {
+				return reduce_where_scalar<U>(predicate.a, predicate.b, predicate.op, false);
+			}
+			template<typename U>
+			Scalar<T> mean_where_scalar(const pending_operation<U, bool> & predicate) {
+				return reduce_where_scalar<U>(predicate.a, predicate.b, predicate.op, true);
+			}
+			
+			// reductions that return right away, with the result completing in the background
+			Future<T> sum_async() {
+				if (!initialized) throw "Vector not initialized";
+				return parallel_reduce_async<T>(data, num_filled, reduce_plus);
+			}
+			Future<T> product_async() {
+				if (!initialized) throw "Vector not initialized";
+				return parallel_reduce_async<T>(data, num_filled, reduce_times);
+			}
+			
 			Vector<T> filterBy(const Vector<bool> & vec) {
 				if (!initialized || !vec.initialized) throw "Vector not initialized";
 				if (size() != vec.size()) throw "Vector size mismatch";
@@ -907,6 +2736,55 @@ namespace PV {
 				output.num_filled = parallel_filter<T>(data, vec.data, output.data, size());
 				return output;
 			}
+			// keeps the elements for which the comparison holds, e.g. filterBy(PV::compare_lt(a, b)),
+			// without storing a mask
+			template<typename U>
+			Vector<T> filterBy(const pending_operation<U, bool> & predicate) {
+				if (!initialized || !predicate.a.initialized || !predicate.b.initialized) throw "Vector not initialized";
+				if (size() != predicate.a.size() || size() != predicate.b.size()) throw "Vector size mismatch";
+				Vector<T> output(size());
+				cl::Buffer size_buffer = parallel_filter_if_async<T, U>(data, predicate.a.data, predicate.b.data, predicate.op, output.data, size());
+				output.num_filled = size() == 0 ? 0 : cl.get_GPU_buffer_index<unsigned int>(size_buffer, 0);
+				return output;
+			}
+			// number of elements in each of bins equal bins spanning [lo, hi], elements outside are not counted
+			Vector<unsigned int> histogram(size_type bins, T lo, T hi) {
+				if (!initialized) throw "Vector not initialized";
+				if (bins == 0 || !(lo < hi)) throw "histogram requires bins and lo < hi";
+				Vector<unsigned int> output(bins, 0u);
+				parallel_histogram<T>(data, output.data, bins, false, lo, hi, size());
+				return output;
+			}
+			// number of occurrences of each integer value from 0 to num_bins - 1
+			Vector<unsigned int> bincount(size_type num_bins) {
+				if (!initialized) throw "Vector not initialized";
+				if (num_bins == 0) throw "bincount requires bins";
+				Vector<unsigned int> output(num_bins, 0u);
+				parallel_histogram<T>(data, output.data, num_bins, true, T(0), T(0), size());
+				return output;
+			}
+			// splits the vector into the elements where vec is true and those where it is false, keeping
+			// their order, with a single scan of the mask and a single scatter
+			std::pair<Vector<T>, Vector<T>> partition(const Vector<bool> & vec) const {
+				if (!initialized || !vec.initialized) throw "Vector not initialized";
+				if (size() != vec.size()) throw "Vector size mismatch";
+				std::pair<Vector<T>, Vector<T>> output(Vector<T>(size() > 0 ? size() : 1), Vector<T>(size() > 0 ? size() : 1));
+				cl::Buffer positions = cl.GPU_buffer<cl_uint>(size() > 0 ? size() : 1);
+				cl::Buffer total = parallel_scan<bool>(vec.data, positions, size(), true);
+				parallel_partition<T>(vec.data, positions, data, output.first.data, output.second.data, size());
+				output.first.num_filled = cl.get_GPU_buffer_index<cl_uint>(total, 0);
+				output.second.num_filled = size() - output.first.num_filled;
+				return output;
+			}
+			Future<Vector<T>> filterBy_async(const Vector<bool> & vec) {
+				if (!initialized || !vec.initialized) throw "Vector not initialized";
+				if (size() != vec.size()) throw "Vector size mismatch";
+				Vector<T> output(size());
+				cl::Buffer size_buffer = parallel_filter_async<T>(data, vec.data, output.data, size());
+				return async_read<Vector<T>, unsigned int>(size_buffer, 0, 1, std::move(output), [](Vector<T> & result, const unsigned int * count) {
+					result.num_filled = count[0];
+				});
+			}
 			
 			// ROTATIONS
 			Vector<T> rotateBy(long int rotation) {
@@ -942,20 +2820,22 @@ namespace PV {
 			// first element in vector
 			T front() {
 				if (!initialized) throw "Vector not initialized";
-				if (num_filled > 0) return cl.get_GPU_buffer_index<T>(data, 0);
+				if (num_filled > 0) return host_data ? host_access()[0] : cl.get_GPU_buffer_index<T>(data, 0);
 				else throw "Cannot get front of empty Vector";
 			}
 			// last element in vector
 			T back() {
 				if (!initialized) throw "Vector not initialized";
-				if (num_filled > 0) return cl.get_GPU_buffer_index<T>(data, num_filled-1);
+				if (num_filled > 0) return host_data ? host_access()[num_filled-1] : cl.get_GPU_buffer_index<T>(data, num_filled-1);
 				else throw "Cannot get back of empty Vector";
 			}
 			// push an element onto the vector
 			void push_back(T val) {
 				if (!initialized) init();
 				else if (num_allocated <= num_filled) copy_resize_buffer(num_filled, num_filled * 2);
-				cl.set_GPU_buffer_index<T>(data, num_filled, val);
+				detach();
+				if (host_data) host_access()[num_filled] = val;
+				else cl.set_GPU_buffer_index<T>(data, num_filled, val);
 				++num_filled;
 			}
 			// removes the last element from the vector
@@ -966,58 +2846,1518 @@ namespace PV {
 			
 			
 			
+		protected:
+			// shared virtual memory backing data, nullptr for buffer storage
+			T* host_data;
+		public:
 			cl::Buffer data;
 		protected:
 			// so we can access protected methods accross templates
 			template<typename U>
 			friend class Vector;
 			
-			template<typename T1, typename T2, typename T3, typename T4>
-			void do_operation(Vector<T1> & a, const Vector<T2> & b, const Vector<T3> & c, Vector<T4> & d, enum operation op) {
-				if (!a.initialized || !b.initialized || !c.initialized || !d.initialized) throw "Vector not initialized";
+			// masked reductions, with the mask either a (op < 0) or the comparison op of a and b
+			template<typename U>
+			void reduce_where(const Vector<U> & a, const Vector<U> & b, int op, T & sum, size_type & count) {
+				if (!initialized || !a.initialized || !b.initialized) throw "Vector not initialized";
+				if (size() != a.size() || size() != b.size()) throw "Vector size mismatch";
+				parallel_reduce_where<T, U>(data, a.data, op < 0 ? nullptr : &b.data, op, size(), sum, count);
+			}
+			template<typename U>
+			Scalar<T> reduce_where_scalar(const Vector<U> & a, const Vector<U> & b, int op, bool mean) {
+				if (!initialized || !a.initialized || !b.initialized) throw "Vector not initialized";
+				if (size() != a.size() || size() != b.size()) throw "Vector size mismatch";
+				return Scalar<T>(parallel_reduce_where_device<T, U>(data, a.data, op < 0 ? nullptr : &b.data, op, size(), mean));
+			}
+			
+			template<typename T1, typename T2, typename T3, typename T4>
+			void do_operation(const Vector<T1> & a, const Vector<T2> & b, const Vector<T3> & c, Vector<T4> & d, enum operation op) {
+				if (!a.initialized || !b.initialized || !c.initialized || !d.initialized) throw "Vector not initialized";
 				if (a.size() != b.size() || b.size() != c.size() || c.size() != d.size()) throw "Vector size mismatch";
+				d.detach();
 				parallel_compute<T1, T2, T3, T4>(a.data, b.data, c.data, d.data, a.size(), op);
 			}
 			
 			template<typename T1, typename T2, typename T3>
-			void do_operation(Vector<T1> & a, const Vector<T2> & b, Vector<T3> & c, enum operation op) {
+			void do_operation(const Vector<T1> & a, const Vector<T2> & b, Vector<T3> & c, enum operation op) {
 				if (!a.initialized || !b.initialized || !c.initialized) throw "Vector not initialized";
 				if (a.size() != b.size() || b.size() != c.size()) throw "Vector size mismatch";
+				c.detach();
 				parallel_compute<T1, T2, T3>(a.data, b.data, c.data, a.size(), op);
 			}
 			
 			template<typename T1, typename T2>
-			void do_operation(Vector<T1> & a, Vector<T2> & b, enum operation op) {
+			void do_operation(const Vector<T1> & a, Vector<T2> & b, enum operation op) {
 				if (!a.initialized || !b.initialized) throw "Vector not initialized";
 				if (a.size() != b.size()) throw "Vector size mismatch";
+				b.detach();
 				parallel_compute<T1, T2>(a.data, b.data, a.size(), op);
 			}
 			
+			// when expiring, this Vector is a temporary whose buffer takes the result
+			Vector<T> scalar_operation(const Scalar<T> & scalar, enum operation op, bool expiring = false) {
+				if (!initialized || !scalar.initialized) throw "Vector not initialized";
+				if (expiring && !shares_buffer()) {
+					parallel_compute<T, T, T>(data, scalar.data, data, size(), op, 1 << 1);  // broadcast operand b
+					return std::move(get_this());
+				}
+				Vector<T> output(size());
+				parallel_compute<T, T, T>(data, scalar.data, output.data, size(), op, 1 << 1);
+				return output;
+			}
+			
+			// result of a op b written over expiring, a temporary operand, so no buffer is allocated;
+			// elementwise kernels read each element before writing it, so the output may alias an input
+			Vector<T> operation_into(Vector<T> & expiring, Vector<T> & a, const Vector<T> & b, enum operation op) {
+				if (expiring.shares_buffer()) {
+					Vector<T> output(a.size());
+					do_operation<T,T,T>(a, b, output, op);
+					return output;
+				}
+				do_operation<T,T,T>(a, b, expiring, op);
+				return std::move(expiring);
+			}
+			Vector<T> operation_into(Vector<T> & expiring, enum operation op) {
+				if (expiring.shares_buffer()) {
+					Vector<T> output(expiring.size());
+					do_operation<T,T>(expiring, output, op);
+					return output;
+				}
+				do_operation<T,T>(expiring, expiring, op);
+				return std::move(expiring);
+			}
+			
 			Vector<T> & get_this() {
 				return (*this);
 			}
 			
+			// shared memory pointer, once the device is done with the work enqueued so far
+			T* host_access() {
+				cl.sync();
+				return host_data;
+			}
+			
 			void init() {
-				data = cl.GPU_buffer<T>(init_size);
+				data = cl.GPU_storage<T>(init_size, host_data);
 				num_allocated = init_size;
+				owners = std::make_shared<bool>(true);
+				shared_at = cl::Event();
 			}
 			
 			void copy_resize_buffer(size_type copy_size, size_type new_size) {
-				cl::Buffer buf = cl.GPU_buffer<T>(new_size);
-				parallel_compute<T, T>(data, buf, copy_size, copy);
+				T* new_host_data;
+				cl::Buffer buf = cl.GPU_storage<T>(new_size, new_host_data);
+				cl.copy_buffer<T>(data, buf, copy_size);
 				num_allocated = new_size;
 				data = buf;
+				host_data = new_host_data;
+				owners = std::make_shared<bool>(true);
+				shared_at = cl::Event();
+			}
+			
+			// makes this Vector use the buffer of vec, copying it only once one of them is written; vec is only
+			// read, so several threads can copy the same Vector at once, and the copy records where it was made
+			// so that a deferred duplicate still sees the work enqueued before it on the copying queue
+			void share(const Vector<T> & vec) {
+				owners = vec.owners;
+				data = vec.data;
+				host_data = vec.host_data;
+				num_filled = vec.num_filled;
+				num_allocated = vec.num_allocated;
+				shared_at = cl::Event();
+				if (!cl.capture_target()) cl.get_GPU_queue().enqueueMarkerWithWaitList(nullptr, &shared_at);
+			}
+			
+			// gives this Vector a buffer of its own before it is written, if other Vectors still share it
+			void detach() {
+				if (shares_buffer()) {
+					data = cl.duplicate_buffer<T>(data, num_filled, num_allocated, host_data, shared_at);
+					owners = std::make_shared<bool>(true);
+				}
+				shared_at = cl::Event();
+			}
+			bool shares_buffer() const {
+				return owners && owners.use_count() > 1;
+			}
+			
+			// leaves a moved-from Vector uninitialized and without a buffer
+			void release() {
+				host_data = nullptr;
+				data = cl::Buffer();
+				num_filled = 0;
+				num_allocated = 0;
+				initialized = false;
+				owners.reset();
+				shared_at = cl::Event();
 			}
 			
 			size_type num_filled, num_allocated;
 			bool initialized;
 			const size_type init_size = 8;
+			// shared by the Vectors using the same buffer through copy-on-write, created with every buffer
+			std::shared_ptr<bool> owners;
+			// marker on the queue this Vector was copied on, which duplicating the shared buffer waits for
+			cl::Event shared_at;
+	};
+	
+	// GENERATORS
+	template<typename T>
+	class Generator;
+	
+	// elementwise operation with at least one generated operand, producing a new Vector
+	template<typename R, typename T>
+	Vector<R> generated_operation(const compute_operand<T> & a, const compute_operand<T> & b, size_type size, enum operation op) {
+		Vector<R> output(size);
+		parallel_compute<T, T, R>(a, b, output.data, size, op);
+		return output;
+	}
+	template<typename R, typename T>
+	Vector<R> generated_operation(const Generator<T> & a, const Vector<T> & b, enum operation op) {
+		if (!b.data()) throw "Vector not initialized";
+		if (a.size() != b.size()) throw "Vector size mismatch";
+		return generated_operation<R, T>(compute_operand<T>(a.start, a.step), compute_operand<T>(b.data), a.size(), op);
+	}
+	template<typename R, typename T>
+	Vector<R> generated_operation(const Vector<T> & a, const Generator<T> & b, enum operation op) {
+		if (!a.data()) throw "Vector not initialized";
+		if (a.size() != b.size()) throw "Vector size mismatch";
+		return generated_operation<R, T>(compute_operand<T>(a.data), compute_operand<T>(b.start, b.step), a.size(), op);
+	}
+	template<typename R, typename T>
+	Vector<R> generated_operation(const Generator<T> & a, const Generator<T> & b, enum operation op) {
+		if (a.size() != b.size()) throw "Vector size mismatch";
+		return generated_operation<R, T>(compute_operand<T>(a.start, a.step), compute_operand<T>(b.start, b.step), a.size(), op);
+	}
+	
+	// a Vector-like sequence start + i * step that is never stored: elementwise operations compute its
+	// elements inside their kernels, and materialize() writes it to a Vector only when asked
+	template<typename T>
+	class Generator {
+		public:
+			Generator(size_type length, T start, T step) : length(length), start(start), step(step) {};
+			
+			size_type size() const {
+				return length;
+			}
+			// computed on the host, no device access
+			T operator[] (size_type index) const {
+				return start + (T)index * step;
+			}
+			Vector<T> materialize() const {
+				Vector<T> output(length);
+				parallel_generate<T>(start, step, output.data, length);
+				return output;
+			}
+			
+			// elementwise operations with Vectors and other generators, which produce Vectors
+			Vector<T> operator+ (const Vector<T>& vec) const {
+				return generated_operation<T>(get_this(), vec, plus);
+			}
+			Vector<T> operator+ (const Generator& gen) const {
+				return generated_operation<T>(get_this(), gen, plus);
+			}
+			Vector<T> operator- (const Vector<T>& vec) const {
+				return generated_operation<T>(get_this(), vec, minus);
+			}
+			Vector<T> operator- (const Generator& gen) const {
+				return generated_operation<T>(get_this(), gen, minus);
+			}
+			Vector<T> operator* (const Vector<T>& vec) const {
+				return generated_operation<T>(get_this(), vec, times);
+			}
+			Vector<T> operator* (const Generator& gen) const {
+				return generated_operation<T>(get_this(), gen, times);
+			}
+			Vector<T> operator/ (const Vector<T>& vec) const {
+				return generated_operation<T>(get_this(), vec, divide);
+			}
+			Vector<T> operator/ (const Generator& gen) const {
+				return generated_operation<T>(get_this(), gen, divide);
+			}
+			Vector<T> operator% (const Vector<T>& vec) const {
+				return generated_operation<T>(get_this(), vec, mod);
+			}
+			Vector<T> operator% (const Generator& gen) const {
+				return generated_operation<T>(get_this(), gen, mod);
+			}
+			Vector<bool> operator== (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, equals);
+			}
+			Vector<bool> operator== (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, equals);
+			}
+			Vector<bool> operator!= (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, not_equals);
+			}
+			Vector<bool> operator!= (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, not_equals);
+			}
+			Vector<bool> operator> (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, greater);
+			}
+			Vector<bool> operator> (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, greater);
+			}
+			Vector<bool> operator< (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, lesser);
+			}
+			Vector<bool> operator< (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, lesser);
+			}
+			Vector<bool> operator>= (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, greater_equal);
+			}
+			Vector<bool> operator>= (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, greater_equal);
+			}
+			Vector<bool> operator<= (const Vector<T>& vec) const {
+				return generated_operation<bool>(get_this(), vec, lesser_equal);
+			}
+			Vector<bool> operator<= (const Generator& gen) const {
+				return generated_operation<bool>(get_this(), gen, lesser_equal);
+			}
+			
+			const Generator & get_this() const {
+				return (*this);
+			}
+			
+			const size_type length;
+			const T start, step;
+	};
+	
+	// Vector on the left of a generator
+	template<typename T>
+	Vector<T> operator+ (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<T>(vec, gen, plus);
+	}
+	template<typename T>
+	Vector<T> operator- (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<T>(vec, gen, minus);
+	}
+	template<typename T>
+	Vector<T> operator* (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<T>(vec, gen, times);
+	}
+	template<typename T>
+	Vector<T> operator/ (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<T>(vec, gen, divide);
+	}
+	template<typename T>
+	Vector<T> operator% (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<T>(vec, gen, mod);
+	}
+	template<typename T>
+	Vector<bool> operator== (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, equals);
+	}
+	template<typename T>
+	Vector<bool> operator!= (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, not_equals);
+	}
+	template<typename T>
+	Vector<bool> operator> (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, greater);
+	}
+	template<typename T>
+	Vector<bool> operator< (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, lesser);
+	}
+	template<typename T>
+	Vector<bool> operator>= (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, greater_equal);
+	}
+	template<typename T>
+	Vector<bool> operator<= (const Vector<T>& vec, const Generator<T>& gen) {
+		return generated_operation<bool>(vec, gen, lesser_equal);
+	}
+	
+	// length copies of value
+	template<typename T>
+	Generator<T> constant(size_type length, T value) {
+		return Generator<T>(length, value, T(0));
+	}
+	// start, start + step, start + 2 * step, ...
+	template<typename T>
+	Generator<T> iota(size_type length, T start = T(0), T step = T(1)) {
+		return Generator<T>(length, start, step);
+	}
+	// length evenly spaced values from first to last, both included
+	template<typename T>
+	Generator<T> linspace(size_type length, T first, T last) {
+		return Generator<T>(length, first, length > 1 ? (last - first) / (T)(length - 1) : T(0));
+	}
+	
+	// DESTINATION-PASSING OPERATIONS
+	// write into an existing Vector of the same size, reusing its buffer; the two-operand forms return
+	// a pending operation that out.assign() evaluates into out (quotient and modulo are named so as not to
+	// clash with the divide and mod operations)
+	template<typename T>
+	pending_operation<T, T> add(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, T>(a, b, plus);
+	}
+	template<typename T>
+	Vector<T> & add(const Vector<T> & a, const Vector<T> & b, Vector<T> & out) {
+		return out.assign(add(a, b));
+	}
+	template<typename T>
+	pending_operation<T, T> subtract(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, T>(a, b, minus);
+	}
+	template<typename T>
+	Vector<T> & subtract(const Vector<T> & a, const Vector<T> & b, Vector<T> & out) {
+		return out.assign(subtract(a, b));
+	}
+	template<typename T>
+	pending_operation<T, T> multiply(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, T>(a, b, times);
+	}
+	template<typename T>
+	Vector<T> & multiply(const Vector<T> & a, const Vector<T> & b, Vector<T> & out) {
+		return out.assign(multiply(a, b));
+	}
+	template<typename T>
+	pending_operation<T, T> quotient(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, T>(a, b, divide);
+	}
+	template<typename T>
+	Vector<T> & quotient(const Vector<T> & a, const Vector<T> & b, Vector<T> & out) {
+		return out.assign(quotient(a, b));
+	}
+	template<typename T>
+	pending_operation<T, T> modulo(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, T>(a, b, mod);
+	}
+	template<typename T>
+	Vector<T> & modulo(const Vector<T> & a, const Vector<T> & b, Vector<T> & out) {
+		return out.assign(modulo(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_eq(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, equals);
+	}
+	template<typename T>
+	Vector<bool> & compare_eq(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_eq(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_ne(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, not_equals);
+	}
+	template<typename T>
+	Vector<bool> & compare_ne(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_ne(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_lt(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, lesser);
+	}
+	template<typename T>
+	Vector<bool> & compare_lt(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_lt(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_gt(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, greater);
+	}
+	template<typename T>
+	Vector<bool> & compare_gt(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_gt(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_le(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, lesser_equal);
+	}
+	template<typename T>
+	Vector<bool> & compare_le(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_le(a, b));
+	}
+	template<typename T>
+	pending_operation<T, bool> compare_ge(const Vector<T> & a, const Vector<T> & b) {
+		return pending_operation<T, bool>(a, b, greater_equal);
+	}
+	template<typename T>
+	Vector<bool> & compare_ge(const Vector<T> & a, const Vector<T> & b, Vector<bool> & out) {
+		return out.assign(compare_ge(a, b));
+	}
+
+	// SEARCHES WITH PREDICATES
+	// the comparison, such as PV::compare_lt(a, b), is evaluated inside the search kernel without a mask
+	template<typename T>
+	size_type find_first(const pending_operation<T, bool> & predicate) {
+		if (!predicate.a.data() || !predicate.b.data()) throw "Vector not initialized";
+		if (predicate.a.size() != predicate.b.size()) throw "Vector size mismatch";
+		return parallel_find<T>(predicate.a.data, &predicate.b.data, predicate.op, true, predicate.a.size());
+	}
+	template<typename T>
+	bool any(const pending_operation<T, bool> & predicate) {
+		return find_first(predicate) < predicate.a.size();
+	}
+	template<typename T>
+	bool all(const pending_operation<T, bool> & predicate) {
+		if (!predicate.a.data() || !predicate.b.data()) throw "Vector not initialized";
+		if (predicate.a.size() != predicate.b.size()) throw "Vector size mismatch";
+		return parallel_find<T>(predicate.a.data, &predicate.b.data, predicate.op, false, predicate.a.size()) == predicate.a.size();
+	}
+	template<typename T>
+	size_type count_if(const pending_operation<T, bool> & predicate) {
+		if (!predicate.a.data() || !predicate.b.data()) throw "Vector not initialized";
+		if (predicate.a.size() != predicate.b.size()) throw "Vector size mismatch";
+		return parallel_count<T>(predicate.a.data, &predicate.b.data, predicate.op, true, predicate.a.size());
+	}
+	
+	// an elementwise operation on two generators that is only evaluated inside the search consuming it,
+	// e.g. PV::find_first(PV::compare_eq(PV::modulo(keys, nums), zeros)) never stores the remainders
+	template<typename T>
+	struct generated_term {
+		generated_term(const Generator<T> & a, const Generator<T> & b, enum operation op) : a(a), b(b), op(op) {};
+		Generator<T> a, b;
+		enum operation op;
+	};
+	
+	// the comparison of a generator, or of a generated_term, with another generator, for the searches below
+	template<typename T>
+	struct generated_predicate {
+		generated_predicate(const Generator<T> & a, const Generator<T> & c, enum operation op) : a(a), b(a), c(c), arithmetic(-1), op(op) {
+			if (a.size() != c.size()) throw "Vector size mismatch";
+		};
+		generated_predicate(const generated_term<T> & term, const Generator<T> & c, enum operation op) :
+			a(term.a), b(term.b), c(c), arithmetic(term.op), op(op) {
+			if (a.size() != b.size() || a.size() != c.size()) throw "Vector size mismatch";
+		};
+		// kernel parameters and condition computing the elements of the generators from their start and step
+		void code(std::string & params, std::string & condition) const {
+			const std::string T_s = typeToStr<T>();
+			params = "const " + T_s + " a_start, const " + T_s + " a_step, const " + T_s + " b_start, const " + T_s + " b_step, "
+			         "const " + T_s + " c_start, const " + T_s + " c_step, ";
+			condition = T_s + " a = a_start + (" + T_s + ")i * a_step; " + T_s + " b = b_start + (" + T_s + ")i * b_step; ";
+			if (arithmetic >= 0) condition += std::string("{ ") + T_s + " c; " + op_to_str[arithmetic] + " a = c; } ";
+			condition += "b = c_start + (" + T_s + ")i * c_step; bool c; " + op_to_str[op];
+		}
+		Generator<T> a, b, c;
+		int arithmetic;  // operation applied to a and b before comparing with c, or -1 to compare a itself
+		enum operation op;
 	};
 	
+	template<typename T>
+	generated_term<T> add(const Generator<T> & a, const Generator<T> & b) {
+		return generated_term<T>(a, b, plus);
+	}
+	template<typename T>
+	generated_term<T> subtract(const Generator<T> & a, const Generator<T> & b) {
+		return generated_term<T>(a, b, minus);
+	}
+	template<typename T>
+	generated_term<T> multiply(const Generator<T> & a, const Generator<T> & b) {
+		return generated_term<T>(a, b, times);
+	}
+	template<typename T>
+	generated_term<T> quotient(const Generator<T> & a, const Generator<T> & b) {
+		return generated_term<T>(a, b, divide);
+	}
+	template<typename T>
+	generated_term<T> modulo(const Generator<T> & a, const Generator<T> & b) {
+		return generated_term<T>(a, b, mod);
+	}
+	template<typename T>
+	generated_predicate<T> compare_eq(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, equals);
+	}
+	template<typename T>
+	generated_predicate<T> compare_eq(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, equals);
+	}
+	template<typename T>
+	generated_predicate<T> compare_ne(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, not_equals);
+	}
+	template<typename T>
+	generated_predicate<T> compare_ne(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, not_equals);
+	}
+	template<typename T>
+	generated_predicate<T> compare_lt(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, lesser);
+	}
+	template<typename T>
+	generated_predicate<T> compare_lt(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, lesser);
+	}
+	template<typename T>
+	generated_predicate<T> compare_gt(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, greater);
+	}
+	template<typename T>
+	generated_predicate<T> compare_gt(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, greater);
+	}
+	template<typename T>
+	generated_predicate<T> compare_le(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, lesser_equal);
+	}
+	template<typename T>
+	generated_predicate<T> compare_le(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, lesser_equal);
+	}
+	template<typename T>
+	generated_predicate<T> compare_ge(const Generator<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, greater_equal);
+	}
+	template<typename T>
+	generated_predicate<T> compare_ge(const generated_term<T> & a, const Generator<T> & b) {
+		return generated_predicate<T>(a, b, greater_equal);
+	}
+	
+	// searches over generated predicates, which read no memory at all
+	template<typename T>
+	size_type find_first(const generated_predicate<T> & predicate) {
+		std::string params, condition;
+		predicate.code(params, condition);
+		return parallel_find<T>(params, condition, predicate.op, true, predicate.a.size(), predicate.a.start, predicate.a.step,
+		                        predicate.b.start, predicate.b.step, predicate.c.start, predicate.c.step);
+	}
+	template<typename T>
+	bool any(const generated_predicate<T> & predicate) {
+		return find_first(predicate) < predicate.a.size();
+	}
+	template<typename T>
+	bool all(const generated_predicate<T> & predicate) {
+		std::string params, condition;
+		predicate.code(params, condition);
+		return parallel_find<T>(params, condition, predicate.op, false, predicate.a.size(), predicate.a.start, predicate.a.step,
+		                        predicate.b.start, predicate.b.step, predicate.c.start, predicate.c.step) == predicate.a.size();
+	}
+	template<typename T>
+	size_type count_if(const generated_predicate<T> & predicate) {
+		std::string params, condition;
+		predicate.code(params, condition);
+		return parallel_count<T>(params, condition, predicate.op, true, predicate.a.size(), predicate.a.start, predicate.a.step,
+		                         predicate.b.start, predicate.b.step, predicate.c.start, predicate.c.step);
+	}
+	
+	// FILTERING SEVERAL COLUMNS
+	// keeps the rows of all columns whose mask element is true, in their original order; the output
+	// positions are computed once with a scan of the mask and shared by every column
+	template<typename T>
+	void filter_columns(const Vector<bool> & mask, std::initializer_list<Vector<T>*> columns) {
+		if (!mask.data()) throw "Vector not initialized";
+		const size_type size = mask.size();
+		for (Vector<T>* column : columns) {
+			if (!column->data()) throw "Vector not initialized";
+			if (column->size() != size) throw "Vector size mismatch";
+		}
+		cl::Buffer positions = cl.GPU_buffer<cl_uint>(size > 0 ? size : 1);
+		cl::Buffer total_buffer = parallel_scan<bool>(mask.data, positions, size, true);
+		const size_type total = cl.get_GPU_buffer_index<cl_uint>(total_buffer, 0);
+		
+		std::vector<Vector<T>> outputs;
+		std::vector<cl::Buffer> ins, outs;
+		for (Vector<T>* column : columns) {
+			outputs.push_back(Vector<T>(total > 0 ? total : 1));
+			if (total == 0) outputs.back().resize(0);
+			ins.push_back(column->data);
+			outs.push_back(outputs.back().data);
+			if (ins.size() == 4) {
+				parallel_compact<T>(mask.data, positions, ins, outs, size);
+				ins.clear();
+				outs.clear();
+			}
+		}
+		if (!ins.empty()) parallel_compact<T>(mask.data, positions, ins, outs, size);
+		size_type k = 0;
+		for (Vector<T>* column : columns) *column = std::move(outputs[k++]);
+	}
+	
+	// AGGREGATING SEVERAL COLUMNS
+	// computes the requested aggregates (e.g. PV::aggregate_sum | PV::aggregate_count) of every column, over
+	// the rows where mask is true if one is given, reading each element once
+	template<typename T>
+	std::vector<aggregate_result<T>> aggregate(const Vector<bool> * mask, std::initializer_list<const Vector<T>*> columns, int kinds) {
+		size_type size = 0;
+		if (mask) {
+			if (!mask->data()) throw "Vector not initialized";
+			size = mask->size();
+		}
+		else if (columns.size() > 0) size = (*columns.begin())->size();
+		for (const Vector<T>* column : columns) {
+			if (!column->data()) throw "Vector not initialized";
+			if (column->size() != size) throw "Vector size mismatch";
+		}
+		std::vector<aggregate_result<T>> results, group;
+		std::vector<cl::Buffer> ins;
+		for (const Vector<T>* column : columns) {
+			ins.push_back(column->data);
+			if (ins.size() == 4) {
+				parallel_aggregate<T>(ins, mask ? &mask->data : nullptr, kinds, size, group);
+				results.insert(results.end(), group.begin(), group.end());
+				ins.clear();
+			}
+		}
+		if (!ins.empty()) {
+			parallel_aggregate<T>(ins, mask ? &mask->data : nullptr, kinds, size, group);
+			results.insert(results.end(), group.begin(), group.end());
+		}
+		return results;
+	}
+	template<typename T>
+	std::vector<aggregate_result<T>> aggregate(std::initializer_list<const Vector<T>*> columns, int kinds = aggregate_all) {
+		return aggregate<T>(nullptr, columns, kinds);
+	}
+	template<typename T>
+	std::vector<aggregate_result<T>> aggregate(const Vector<bool> & mask, std::initializer_list<const Vector<T>*> columns, int kinds = aggregate_all) {
+		return aggregate<T>(&mask, columns, kinds);
+	}
+	
+	// REDUCING SEGMENTS
+	// reduces each run of equal keys of sorted keys with op (PV::aggregate_sum, aggregate_count, aggregate_min
+	// or aggregate_max), returning the distinct keys and their results in order; counts are given as T
+	template<typename K, typename T>
+	std::pair<Vector<K>, Vector<T>> reduce_by_key(const Vector<K> & keys, const Vector<T> & values, enum aggregate_kind op = aggregate_sum) {
+		const char *K_str = typeToStr<K>(), *T_str = typeToStr<T>();
+		if (K_str == nullptr || T_str == nullptr) throw "Unsupported type in computation";
+		if (!keys.data() || !values.data()) throw "Vector not initialized";
+		if (keys.size() != values.size()) throw "Vector size mismatch";
+		const size_type size = keys.size();
+		const std::string heads_code =
+			std::string("__kernel void opencl_segment_heads(global ") + K_str + " *keys, global uint *flags, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i < size) flags[i] = i == 0 || keys[i] != keys[i - 1];\n"
+			"}";
+		const std::string ends_code =
+			std::string("__kernel void opencl_segment_ends(global ") + K_str + " *keys, global uint *flags, global uint *positions, "
+			"global " + T_str + " *scanned, global " + K_str + " *out_keys, global " + T_str + " *out_values, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i >= size || (i + 1 < size && !flags[i + 1])) return;\n"
+			"	const uint segment = positions[i] + flags[i] - 1;\n"
+			"	out_keys[segment] = keys[i];\n"
+			"	out_values[segment] = scanned[i];\n"
+			"}";
+		if (size == 0) {
+			std::pair<Vector<K>, Vector<T>> output(Vector<K>((size_type)1), Vector<T>((size_type)1));
+			output.first.resize(0);
+			output.second.resize(0);
+			return output;
+		}
+		
+		const launch_config config = cl.get_tuning(tuning_key("reduce_by_key", &T_str, 1, op));
+		cl::Buffer flags = cl.GPU_buffer<cl_uint>(size), positions = cl.GPU_buffer<cl_uint>(size), scanned = cl.GPU_buffer<T>(size);
+		cl.enqueue_kernel(cl.get_kernel(heads_code, "opencl_segment_heads"), size, config.local_size, keys.data, flags, (cl_ulong)size);
+		cl::Buffer total = parallel_scan<cl_uint>(flags, positions, size, false);
+		parallel_segmented_scan<T>(values.data, flags, scanned, size, op);
+		const size_type num_segments = cl.get_GPU_buffer_index<cl_uint>(total, 0);
+		std::pair<Vector<K>, Vector<T>> output((Vector<K>(num_segments)), Vector<T>(num_segments));
+		cl.enqueue_kernel(cl.get_kernel(ends_code, "opencl_segment_ends"), size, config.local_size, keys.data, flags, positions, scanned,
+		                  output.first.data, output.second.data, (cl_ulong)size);
+		return output;
+	}
+	
+	// reduces each segment of values from offsets[s] to offsets[s + 1] (CSR style, so offsets has one more
+	// element than there are segments) with op; offsets must be non-decreasing and end at most at size(), and
+	// empty segments give the identity of op
+	template<typename T>
+	Vector<T> segmented_reduce(const Vector<T> & values, const Vector<unsigned int> & offsets, enum aggregate_kind op = aggregate_sum) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		if (!values.data() || !offsets.data()) throw "Vector not initialized";
+		if (offsets.size() == 0) throw "segmented_reduce requires offsets";
+		const size_type size = values.size(), num_segments = offsets.size() - 1;
+		T identity;
+		segment_combine_code<T>(op, identity);
+		const std::string starts_code =
+			"__kernel void opencl_segment_starts(global uint *offsets, global uint *flags, const unsigned long num_segments, const unsigned long size) \n"
+			"{\n"
+			"	const size_t s = get_global_id(0);\n"
+			"	if (s < num_segments && offsets[s] < offsets[s + 1] && offsets[s + 1] <= size) flags[offsets[s]] = 1;\n"
+			"}";
+		const std::string gather_code =
+			std::string("__kernel void opencl_segment_gather(global uint *offsets, global ") + T_str + " *scanned, global " + T_str + " *out, "
+			"const " + T_str + " identity, const unsigned long num_segments, const unsigned long size) \n"
+			"{\n"
+			"	const size_t s = get_global_id(0);\n"
+			"	if (s < num_segments) out[s] = offsets[s] < offsets[s + 1] && offsets[s + 1] <= size ? scanned[offsets[s + 1] - 1] : identity;\n"
+			"}";
+		Vector<T> output(num_segments > 0 ? num_segments : 1, identity);
+		if (num_segments == 0) {
+			output.resize(0);
+			return output;
+		}
+		// the kernels also skip segments reaching past the values, in case offsets decrease somewhere
+		cl::Buffer offsets_buffer = offsets.data;
+		if (cl.get_GPU_buffer_index<cl_uint>(offsets_buffer, num_segments) > size) throw "Segment offsets past the end of the Vector";
+		if (size == 0) return output;
+		
+		const launch_config config = cl.get_tuning(tuning_key("segmented_reduce", &T_str, 1, op));
+		cl::Buffer flags = cl.GPU_buffer<cl_uint>(size, 0), scanned = cl.GPU_buffer<T>(size);
+		cl.enqueue_kernel(cl.get_kernel(starts_code, "opencl_segment_starts"), num_segments, config.local_size, offsets.data, flags, (cl_ulong)num_segments, (cl_ulong)size);
+		parallel_segmented_scan<T>(values.data, flags, scanned, size, op);
+		cl.enqueue_kernel(cl.get_kernel(gather_code, "opencl_segment_gather"), num_segments, config.local_size, offsets.data, scanned,
+		                  output.data, identity, (cl_ulong)num_segments, (cl_ulong)size);
+		return output;
+	}
+	
+	// sorts keys in place on the device together with indices, ordering equal keys by index; size must be a
+	// power of two, so callers pad keys with the largest value and indices past the real elements
+	template<typename K>
+	void parallel_sort_by_key(cl::Buffer & keys, cl::Buffer & indices, size_type size) {
+		const char *K_str = typeToStr<K>();
+		if (K_str == nullptr) throw "Unsupported type in computation";
+		const std::string kernel_code =
+			std::string("__kernel void opencl_bitonic_step(global ") + K_str + " *keys, global uint *indices, const uint j, const uint k, const uint size) \n"
+			"{\n"
+			"	const uint i = get_global_id(0), partner = i ^ j;\n"
+			"	if (partner <= i || partner >= size) return;\n"
+			"	const " + K_str + " a = keys[i], b = keys[partner];\n"
+			"	const uint ia = indices[i], ib = indices[partner];\n"
+			"	const bool greater = a > b || (a == b && ia > ib);\n"
+			"	if (greater == ((i & k) == 0)) {\n"
+			"		keys[i] = b;\n"
+			"		keys[partner] = a;\n"
+			"		indices[i] = ib;\n"
+			"		indices[partner] = ia;\n"
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_bitonic_step");
+		const launch_config config = cl.get_tuning(tuning_key("sort", &K_str, 1, -1));
+		for (size_type k = 2; k <= size; k <<= 1) {
+			for (size_type j = k >> 1; j > 0; j >>= 1) {
+				cl.enqueue_kernel(kernel, size, config.local_size, keys, indices, (cl_uint)j, (cl_uint)k, (cl_uint)size);
+			}
+		}
+	}
+	
+	// GROUPING
+	// aggregates values by the keys given to PV::group_by, e.g. PV::group_by(keys).agg(values, PV::aggregate_sum);
+	// it keeps a copy of the keys, which shares their buffer
+	template<typename K>
+	class GroupBy {
+		public:
+			explicit GroupBy(const Vector<K> & keys) : keys(keys) {};
+			
+			// the distinct keys and the reduction of their values with op (PV::aggregate_sum, aggregate_count,
+			// aggregate_min or aggregate_max, counts given as T), in no particular order; the keys are inserted into
+			// an open-addressing hash table on the device sized from an estimate of their number, and if it
+			// overflows, or the device lacks the 64-bit atomics that 8-byte keys or values need, they are sorted
+			// and reduced with PV::reduce_by_key instead, ordering them by key
+			template<typename T>
+			std::pair<Vector<K>, Vector<T>> agg(const Vector<T> & values, enum aggregate_kind op = aggregate_sum) const {
+				if (!keys.data() || !values.data()) throw "Vector not initialized";
+				if (keys.size() != values.size()) throw "Vector size mismatch";
+				if (keys.size() >= 0x7FFFFFFFul) throw "Vector too large to group";
+				T identity;
+				segment_combine_code<T>(op, identity);
+				// the table swaps keys and values with 32 or 64-bit compare-and-swap
+				const bool hashable = std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8) && (sizeof(T) == 4 || sizeof(T) == 8) &&
+				                      ((sizeof(K) == 4 && sizeof(T) == 4) || cl.has_extension("cl_khr_int64_base_atomics"));
+				if (hashable && keys.size() > 0) {
+					std::pair<Vector<K>, Vector<T>> output;
+					if (hash_aggregate<T>(values, op, identity, output)) return output;
+				}
+				return sort_aggregate<T>(values, op);
+			}
+			
+		private:
+			Vector<K> keys;
+			
+			// kernels of the hash table for keys K and values T
+			template<typename T>
+			static std::string hash_kernel_code(enum aggregate_kind op) {
+				const std::string K_s = typeToStr<K>(), T_s = typeToStr<T>();
+				const std::string KI_s = sizeof(K) == 8 ? "ulong" : "uint", TI_s = sizeof(T) == 8 ? "ulong" : "uint";
+				const std::string K_cmpxchg = sizeof(K) == 8 ? "atom_cmpxchg" : "atomic_cmpxchg", T_cmpxchg = sizeof(T) == 8 ? "atom_cmpxchg" : "atomic_cmpxchg";
+				T identity;
+				return std::string(sizeof(K) == 8 || sizeof(T) == 8 ? "#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable\n" : "") +
+					segment_combine_code<T>(op, identity) +
+					"uint hash(const " + K_s + " key) \n"
+					"{\n"
+					"	ulong x = (ulong)key;\n"
+					"	x ^= x >> 33;\n"
+					"	x *= 0xff51afd7ed558ccdUL;\n"
+					"	x ^= x >> 33;\n"
+					"	x *= 0xc4ceb9fe1a85ec53UL;\n"
+					"	x ^= x >> 33;\n"
+					"	return (uint)x;\n"
+					"}\n"
+					"void update(volatile global " + T_s + " *p, const " + T_s + " v) \n"
+					"{\n"
+					"	union { " + TI_s + " i; " + T_s + " f; } old_value, new_value;\n"
+					"	do {\n"
+					"		old_value.f = *p;\n"
+					"		new_value.f = combine(old_value.f, v);\n"
+					"	} while (" + T_cmpxchg + "((volatile global " + TI_s + " *)p, old_value.i, new_value.i) != old_value.i);\n"
+					"}\n"
+					// linear counting: the fraction of bits of a 65536-bit sketch left unset estimates the number of keys
+					"__kernel void opencl_hash_sketch(global " + K_s + " *keys, global uint *sketch, local uint *local_sketch, const unsigned long size) \n"
+					"{\n"
+					"	const size_t lid = get_local_id(0), n = get_local_size(0);\n"
+					"	for (uint j = lid; j < 2048; j += n) local_sketch[j] = 0;\n"
+					"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+					"	for (unsigned long i = get_global_id(0); i < size; i += get_global_size(0)) {\n"
+					"		const uint h = hash(keys[i]) >> 16;\n"
+					"		atomic_or(&local_sketch[h >> 5], 1u << (h & 31));\n"
+					"	}\n"
+					"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+					"	for (uint j = lid; j < 2048; j += n) {\n"
+					"		if (local_sketch[j]) atomic_or(&sketch[j], local_sketch[j]);\n"
+					"	}\n"
+					"}\n"
+					// slot capacity holds the key equal to empty; flags[0] is set on overflow, flags[1] when that slot is used
+					"__kernel void opencl_hash_insert(global " + K_s + " *keys, global " + T_s + " *values, global " + K_s + " *table_keys, "
+					"global " + T_s + " *table_values, global uint *table_counts, global uint *flags, const " + K_s + " empty, "
+					"const uint capacity, const uint max_probes, const unsigned long size) \n"
+					"{\n"
+					"	for (unsigned long i = get_global_id(0); i < size; i += get_global_size(0)) {\n"
+					"		const " + K_s + " key = keys[i];\n"
+					"		uint slot = capacity;\n"
+					"		if (key != empty) {\n"
+					"			uint h = hash(key) & (capacity - 1), probe = 0;\n"
+					"			for (; probe < max_probes; ++probe, h = (h + 1) & (capacity - 1)) {\n"
+					"				" + K_s + " current = table_keys[h];\n"
+					"				if (current == empty) {\n"
+					"					current = (" + K_s + ")" + K_cmpxchg + "((volatile global " + KI_s + " *)&table_keys[h], (" + KI_s + ")empty, (" + KI_s + ")key);\n"
+					"					if (current == empty) current = key;\n"
+					"				}\n"
+					"				if (current == key) break;\n"
+					"			}\n"
+					"			if (probe == max_probes) {\n"
+					"				flags[0] = 1;\n"
+					"				continue;\n"
+					"			}\n"
+					"			slot = h;\n"
+					"		}\n"
+					"		else flags[1] = 1;\n" +
+					(op == aggregate_count ? "		atomic_inc(&table_counts[slot]);\n" : "		update(&table_values[slot], values[i]);\n") +
+					"	}\n"
+					"}\n"
+					"__kernel void opencl_hash_occupied(global " + K_s + " *table_keys, global uint *flags, global uint *occupied, "
+					"const " + K_s + " empty, const uint capacity) \n"
+					"{\n"
+					"	const uint slot = get_global_id(0);\n"
+					"	if (slot < capacity) occupied[slot] = table_keys[slot] != empty;\n"
+					"	else if (slot == capacity) occupied[slot] = flags[1];\n"
+					"}\n"
+					"__kernel void opencl_hash_compact(global " + K_s + " *table_keys, global " + T_s + " *table_values, global uint *table_counts, "
+					"global uint *occupied, global uint *positions, global " + K_s + " *out_keys, global " + T_s + " *out_values, "
+					"const " + K_s + " empty, const uint capacity) \n"
+					"{\n"
+					"	const uint slot = get_global_id(0);\n"
+					"	if (slot > capacity || !occupied[slot]) return;\n"
+					"	const uint position = positions[slot];\n"
+					"	out_keys[position] = slot == capacity ? empty : table_keys[slot];\n"
+					"	out_values[position] = " + (op == aggregate_count ? "(" + T_s + ")table_counts[slot]" : std::string("table_values[slot]")) + ";\n"
+					"}";
+			}
+			
+			// groups through the hash table, returning false if it overflowed or the sketch does not fit in local memory
+			template<typename T>
+			bool hash_aggregate(const Vector<T> & values, enum aggregate_kind op, T identity, std::pair<Vector<K>, Vector<T>> & output) const {
+				const std::string kernel_code = hash_kernel_code<T>(op);
+				cl::Kernel sketch_kernel = cl.get_kernel(kernel_code, "opencl_hash_sketch");
+				cl::Kernel insert_kernel = cl.get_kernel(kernel_code, "opencl_hash_insert");
+				const size_type size = keys.size();
+				const char *K_str = typeToStr<K>();
+				const launch_config config = cl.get_tuning(tuning_key("group_by", &K_str, 1, op));
+				
+				// estimate the number of distinct keys, all of them being distinct once the sketch is full
+				const size_type sketch_bits = 65536;
+				if (!cl.fits_local_memory(sketch_kernel, sketch_bits / 8)) return false;
+				const size_type local_size = cl.work_group_size(sketch_kernel, config.local_size ? config.local_size : 256);
+				const size_type num_groups = std::min((size + local_size - 1) / local_size, (size_type)cl.get_compute_units() * 4);
+				cl::Buffer sketch = cl.GPU_buffer<cl_uint>(sketch_bits / 32, 0);
+				cl.enqueue_kernel(sketch_kernel, num_groups * local_size, local_size, keys.data, sketch, cl::Local(sketch_bits / 8), (cl_ulong)size);
+				std::vector<cl_uint> host_sketch(sketch_bits / 32);
+				cl.from_GPU_buffer(sketch, 0, host_sketch);
+				size_type bits_set = 0;
+				for (cl_uint word : host_sketch) bits_set += std::bitset<32>(word).count();
+				const double estimate = bits_set < sketch_bits ? sketch_bits * std::log((double)sketch_bits / (sketch_bits - bits_set)) : size;
+				
+				// keep the table at most half full if the estimate holds
+				const size_type target = std::min(size, (size_type)(estimate * 1.25) + 16);
+				size_type capacity = 64;
+				while (capacity < 2 * target) capacity <<= 1;
+				const K empty = std::numeric_limits<K>::max();
+				cl::Buffer table_keys = cl.GPU_buffer<K>(capacity + 1, empty);
+				cl::Buffer table_values = cl.GPU_buffer<T>(capacity + 1, identity);
+				cl::Buffer table_counts = cl.GPU_buffer<cl_uint>(capacity + 1, 0);
+				cl::Buffer flags = cl.GPU_buffer<cl_uint>(2, 0);
+				const size_type max_probes = std::min(capacity, (size_type)128);
+				cl.enqueue_kernel(insert_kernel, num_groups * local_size, local_size, keys.data, values.data, table_keys, table_values,
+				                  table_counts, flags, empty, (cl_uint)capacity, (cl_uint)max_probes, (cl_ulong)size);
+				if (cl.get_GPU_buffer_index<cl_uint>(flags, 0)) return false;
+				
+				// compact the used slots
+				cl::Buffer occupied = cl.GPU_buffer<cl_uint>(capacity + 1), positions = cl.GPU_buffer<cl_uint>(capacity + 1);
+				cl.enqueue_kernel(cl.get_kernel(kernel_code, "opencl_hash_occupied"), capacity + 1, config.local_size, table_keys, flags,
+				                  occupied, empty, (cl_uint)capacity);
+				cl::Buffer total = parallel_scan<cl_uint>(occupied, positions, capacity + 1, false);
+				const size_type num_keys = cl.get_GPU_buffer_index<cl_uint>(total, 0);
+				output.first = Vector<K>(num_keys);
+				output.second = Vector<T>(num_keys);
+				cl.enqueue_kernel(cl.get_kernel(kernel_code, "opencl_hash_compact"), capacity + 1, config.local_size, table_keys, table_values,
+				                  table_counts, occupied, positions, output.first.data, output.second.data, empty, (cl_uint)capacity);
+				return true;
+			}
+			
+			// groups by sorting the keys with the positions of their values and reducing the runs of equal keys
+			template<typename T>
+			std::pair<Vector<K>, Vector<T>> sort_aggregate(const Vector<T> & values, enum aggregate_kind op) const {
+				const size_type size = keys.size();
+				if (size == 0) return reduce_by_key(keys, values, op);
+				const char *T_str = typeToStr<T>();
+				const std::string gather_code =
+					std::string("__kernel void opencl_gather(global uint *indices, global ") + T_str + " *values, global " + T_str + " *out, "
+					"const unsigned long size) \n"
+					"{\n"
+					"	const size_t i = get_global_id(0);\n"
+					"	if (i < size) out[i] = values[indices[i]];\n"
+					"}";
+				size_type padded = 1;
+				while (padded < size) padded <<= 1;
+				cl::Buffer sorted_keys = cl.GPU_buffer<K>(padded, std::numeric_limits<K>::max()), indices = cl.GPU_buffer<cl_uint>(padded);
+				cl.copy_buffer<K>(keys.data, sorted_keys, size);
+				parallel_indices<cl_uint>(indices, padded);
+				parallel_sort_by_key<K>(sorted_keys, indices, padded);
+				
+				Vector<K> grouped_keys(size);
+				Vector<T> grouped_values(size);
+				cl.copy_buffer<K>(sorted_keys, grouped_keys.data, size);
+				const launch_config config = cl.get_tuning(tuning_key("gather", &T_str, 1, -1));
+				cl.enqueue_kernel(cl.get_kernel(gather_code, "opencl_gather"), size, config.local_size, indices, values.data, grouped_values.data, (cl_ulong)size);
+				return reduce_by_key(grouped_keys, grouped_values, op);
+			}
+	};
+	
+	template<typename K>
+	GroupBy<K> group_by(const Vector<K> & keys) {
+		return GroupBy<K>(keys);
+	}
+	
+	// copies equally long columns one after the other into a single buffer, so kernels can take any number
+	// of them (element i of column d at d * size + i)
+	template<typename T>
+	cl::Buffer pack_columns(const std::vector<const Vector<T>*> & columns) {
+		const char *T_str = typeToStr<T>();
+		if (T_str == nullptr) throw "Unsupported type in computation";
+		const std::string kernel_code =
+			std::string("__kernel void opencl_pack(global ") + T_str + " *in, global " + T_str + " *out, const unsigned long offset, const unsigned long size) \n"
+			"{\n"
+			"	const size_t i = get_global_id(0);\n"
+			"	if (i < size) out[offset + i] = in[i];\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_pack");
+		const size_type size = columns.empty() ? 0 : columns.front()->size();
+		for (const Vector<T>* column : columns) {
+			if (!column->data()) throw "Vector not initialized";
+			if (column->size() != size) throw "Vector size mismatch";
+		}
+		cl::Buffer packed = cl.GPU_buffer<T>(size * columns.size() > 0 ? size * columns.size() : 1);
+		const launch_config config = cl.get_tuning(tuning_key("pack", &T_str, 1, -1));
+		for (size_type d = 0; d < columns.size() && size > 0; ++d) {
+			cl.enqueue_kernel(kernel, size, config.local_size, columns[d]->data, packed, (cl_ulong)(d * size), (cl_ulong)size);
+		}
+		return packed;
+	}
+	
+	// K-MEANS CLUSTERING
+	// kernels of PV::kmeans for points of type T stored dimension by dimension (coordinate d of point i at
+	// d * num_points + i) and centroids stored point by point (coordinate d of centroid c at c * dims + d);
+	// opencl_kmeans_step accumulates the cluster sums in local memory when privatized, and otherwise in
+	// a slice of partial_sums of its own; status holds the points that changed cluster, the clusters that
+	// moved further than the tolerance and the iterations run, and once converged is set the step, combine
+	// and check kernels do nothing, so iterations enqueued past convergence cost only their launch
+	template<typename T>
+	cl::Kernel kmeans_kernel(const char* name, bool privatized) {
+		if (!std::is_same<T, float>::value) throw "kmeans requires float points";
+		const std::string T_s = typeToStr<T>();
+		const std::string space = privatized ? "local" : "global";
+		const std::string kernel_code =
+			"void add_to(volatile " + space + " " + T_s + " *p, const " + T_s + " v) \n"
+			"{\n"
+			"	union { uint i; " + T_s + " f; } old_value, new_value;\n"
+			"	do {\n"
+			"		old_value.f = *p;\n"
+			"		new_value.f = old_value.f + v;\n"
+			"	} while (atomic_cmpxchg((volatile " + space + " uint *)p, old_value.i, new_value.i) != old_value.i);\n"
+			"}\n"
+			"__kernel void opencl_kmeans_seed(global " + T_s + " *points, global " + T_s + " *min_distances, global " + T_s + " *block_sums, "
+			"local " + T_s + " *scratch, const unsigned long center, const uint dims, const unsigned long block_size, const unsigned long num_points) \n"
+			"{\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0);\n"
+			"	const unsigned long start = get_group_id(0) * block_size, end = min(start + block_size, num_points);\n"
+			"	" + T_s + " accum = 0;\n"
+			"	for (unsigned long i = start + lid; i < end; i += n) {\n"
+			"		" + T_s + " distance = 0;\n"
+			"		for (uint d = 0; d < dims; ++d) {\n"
+			"			const " + T_s + " diff = points[d * num_points + i] - points[d * num_points + center];\n"
+			"			distance += diff * diff;\n"
+			"		}\n"
+			"		const " + T_s + " m = fmin(min_distances[i], distance);\n"
+			"		min_distances[i] = m;\n"
+			"		accum += m;\n"
+			"	}\n"
+			+ group_reduce_code("accum", "scratch[lid] + scratch[lid + s]", "block_sums[get_group_id(0)]") +
+			"}\n"
+			"__kernel void opencl_kmeans_gather(global " + T_s + " *points, global uint *indices, global " + T_s + " *centroids, "
+			"const uint k, const uint dims, const unsigned long num_points) \n"
+			"{\n"
+			"	const uint j = get_global_id(0);\n"
+			"	if (j < k * dims) centroids[j] = points[(j % dims) * num_points + indices[j / dims]];\n"
+			"}\n"
+			"__kernel void opencl_kmeans_step(global " + T_s + " *points, global " + T_s + " *centroids, global uint *assignments, "
+			"global " + T_s + " *partial_sums, global uint *partial_counts, global uint *status, global bool *converged, local " + T_s + " *local_centroids, "
+			"local " + T_s + " *local_sums, local uint *local_counts, const " + T_s + " max_distance, const uint k, const uint dims, const unsigned long num_points) \n"
+			"{\n"
+			"	if (*converged) return;\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0), group = get_group_id(0);\n"
+			"	const uint kd = k * dims;\n" +
+			(privatized ?
+			"	local " + T_s + " *cents = local_centroids;\n"
+			"	local " + T_s + " *sums = local_sums;\n"
+			"	local uint *counts = local_counts;\n"
+			"	for (uint j = lid; j < kd; j += n) {\n"
+			"		cents[j] = centroids[j];\n"
+			"		sums[j] = 0;\n"
+			"	}\n"
+			"	for (uint j = lid; j < k; j += n) counts[j] = 0;\n"
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			:
+			"	global " + T_s + " *cents = centroids;\n"
+			"	global " + T_s + " *sums = partial_sums + group * kd;\n"
+			"	global uint *counts = partial_counts + group * k;\n") +
+			"	uint my_changed = 0;\n"
+			"	for (unsigned long i = get_global_id(0); i < num_points; i += get_global_size(0)) {\n"
+			"		uint best = 0;\n"
+			"		" + T_s + " best_distance = max_distance;\n"
+			"		for (uint c = 0; c < k; ++c) {\n"
+			"			" + T_s + " distance = 0;\n"
+			"			for (uint d = 0; d < dims; ++d) {\n"
+			"				const " + T_s + " diff = points[d * num_points + i] - cents[c * dims + d];\n"
+			"				distance += diff * diff;\n"
+			"			}\n"
+			"			if (distance < best_distance) {\n"
+			"				best_distance = distance;\n"
+			"				best = c;\n"
+			"			}\n"
+			"		}\n"
+			"		if (assignments[i] != best) {\n"
+			"			assignments[i] = best;\n"
+			"			++my_changed;\n"
+			"		}\n"
+			"		for (uint d = 0; d < dims; ++d) add_to(&sums[best * dims + d], points[d * num_points + i]);\n"
+			"		atomic_inc(&counts[best]);\n"
+			"	}\n"
+			"	if (my_changed > 0) atomic_add(&status[0], my_changed);\n" +
+			(privatized ?
+			"	barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"	for (uint j = lid; j < kd; j += n) partial_sums[group * kd + j] = sums[j];\n"
+			"	for (uint j = lid; j < k; j += n) partial_counts[group * k + j] = counts[j];\n"
+			: "") +
+			"}\n"
+			// moves each centroid to the mean of its points, empty clusters keep their centroid
+			"__kernel void opencl_kmeans_combine(global " + T_s + " *partial_sums, global uint *partial_counts, global " + T_s + " *centroids, "
+			"global uint *counts, global uint *status, global bool *converged, const " + T_s + " tolerance2, const uint k, const uint dims, "
+			"const uint num_groups) \n"
+			"{\n"
+			"	const uint c = get_global_id(0), kd = k * dims;\n"
+			"	if (c >= k || *converged) return;\n"
+			"	uint count = 0;\n"
+			"	for (uint g = 0; g < num_groups; ++g) count += partial_counts[g * k + c];\n"
+			"	counts[c] = count;\n"
+			"	if (count == 0) return;\n"
+			"	" + T_s + " move = 0;\n"
+			"	for (uint d = 0; d < dims; ++d) {\n"
+			"		" + T_s + " sum = 0;\n"
+			"		for (uint g = 0; g < num_groups; ++g) sum += partial_sums[g * kd + c * dims + d];\n"
+			"		const " + T_s + " coordinate = sum / (" + T_s + ")count;\n"
+			"		const " + T_s + " diff = coordinate - centroids[c * dims + d];\n"
+			"		move += diff * diff;\n"
+			"		centroids[c * dims + d] = coordinate;\n"
+			"	}\n"
+			"	if (move > tolerance2) atomic_inc(&status[1]);\n"
+			"}\n"
+			"__kernel void opencl_kmeans_check(global uint *status, global bool *converged) \n"
+			"{\n"
+			"	if (*converged) return;\n"
+			"	++status[2];\n"
+			"	*converged = status[0] == 0 || status[1] == 0;\n"
+			"	status[0] = 0;\n"
+			"	status[1] = 0;\n"
+			"}";
+		return cl.get_kernel(kernel_code, name);
+	}
+	
+	template<typename T>
+	struct kmeans_result {
+		std::vector<T> centroids;        // coordinate d of centroid c at c * dims + d
+		std::vector<size_type> counts;   // number of points in each cluster
+		Vector<unsigned int> assignments; // cluster of each point
+		size_type iterations;
+		bool converged;
+	};
+	
+	// clusters the points whose coordinates are given by the columns into k clusters, starting from a
+	// k-means++ seeding; each iteration assigns every point to its nearest centroid, accumulates the cluster
+	// sums and moves the centroids on the device, and the iterations stop once no point changes cluster, no
+	// centroid moves further than tolerance, or max_iterations have run; PV::loop_until checks convergence
+	// without waiting for each iteration, so the results are only read back at the end
+	template<typename T>
+	kmeans_result<T> kmeans(const std::vector<const Vector<T>*> & columns, size_type k, size_type max_iterations = 100,
+	                        T tolerance = 0, unsigned seed = 0) {
+		const size_type dims = columns.size();
+		if (dims == 0) throw "kmeans requires at least one dimension";
+		for (const Vector<T>* column : columns) {
+			if (!column->data()) throw "Vector not initialized";
+			if (column->size() != columns.front()->size()) throw "Vector size mismatch";
+		}
+		const size_type num_points = columns.front()->size();
+		if (k == 0 || k > num_points) throw "kmeans requires between 1 and size() clusters";
+		if (num_points >= 0xFFFFFFFFul) throw "Vector too large to cluster";
+		const size_type kd = k * dims;
+		
+		// privatize the cluster sums in local memory when they fit, next to the centroids
+		const size_type local_bytes = 2 * kd * sizeof(T) + k * sizeof(cl_uint);
+		cl::Kernel step_kernel = kmeans_kernel<T>("opencl_kmeans_step", true);
+		const bool privatized = cl.fits_local_memory(step_kernel, local_bytes);
+		if (!privatized) step_kernel = kmeans_kernel<T>("opencl_kmeans_step", false);
+		cl::Kernel seed_kernel = kmeans_kernel<T>("opencl_kmeans_seed", privatized);
+		const char *T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("kmeans", &T_str, 1, -1));
+		
+		cl::Buffer points = pack_columns<T>(columns);
+		
+		// k-means++: each centroid after the first is a point drawn with probability proportional to its
+		// squared distance to the nearest centroid so far; the device keeps those distances and the sums of
+		// contiguous blocks of them, so the host only reads the block sums and one block per draw
+		std::mt19937 generator(seed);
+		std::vector<cl_uint> centers(1, std::uniform_int_distribution<size_type>(0, num_points - 1)(generator));
+		cl::Buffer min_distances = cl.GPU_buffer<T>(num_points, std::numeric_limits<T>::max());
+		const size_type seed_local_size = cl.work_group_size(seed_kernel, config.local_size ? config.local_size : 256);
+		const size_type num_blocks = std::min(num_points, (size_type)1024);
+		const size_type block_size = (num_points + num_blocks - 1) / num_blocks;
+		cl::Buffer block_sums = cl.GPU_buffer<T>(num_blocks);
+		std::vector<T> host_block_sums(num_blocks), block(block_size);
+		while (centers.size() < k) {
+			cl.enqueue_kernel(seed_kernel, num_blocks * seed_local_size, seed_local_size, points, min_distances, block_sums,
+			                  cl::Local(seed_local_size * sizeof(T)), (cl_ulong)centers.back(), (cl_uint)dims, (cl_ulong)block_size, (cl_ulong)num_points);
+			cl.from_GPU_buffer(block_sums, 0, host_block_sums);
+			T total = 0;
+			for (size_type b = 0; b < num_blocks; ++b) total += host_block_sums[b];
+			if (!(total > 0)) {
+				// every point is already a centroid
+				centers.push_back(std::uniform_int_distribution<size_type>(0, num_points - 1)(generator));
+				continue;
+			}
+			T target = std::uniform_real_distribution<T>(0, total)(generator);
+			size_type b = 0;
+			while (b + 1 < num_blocks && (target >= host_block_sums[b] || host_block_sums[b] == 0)) target -= host_block_sums[b++];
+			const size_type start = b * block_size, length = std::min(block_size, num_points - start);
+			cl.from_GPU_buffer(min_distances, start, block.data(), length);
+			size_type chosen = start + length - 1;
+			for (size_type i = 0; i < length; ++i) {
+				if (block[i] > 0 && target < block[i]) {
+					chosen = start + i;
+					break;
+				}
+				target -= block[i];
+			}
+			centers.push_back(chosen);
+		}
+		cl::Buffer center_buffer = cl.GPU_buffer<cl_uint>(k);
+		cl.to_GPU_buffer(center_buffer, 0, centers);
+		cl::Buffer centroids = cl.GPU_buffer<T>(kd);
+		cl.enqueue_kernel(kmeans_kernel<T>("opencl_kmeans_gather", privatized), kd, config.local_size, points, center_buffer, centroids,
+		                  (cl_uint)k, (cl_uint)dims, (cl_ulong)num_points);
+		
+		const size_type local_size = cl.work_group_size(step_kernel, config.local_size ? config.local_size : 256);
+		const size_type num_groups = std::min((num_points + local_size - 1) / local_size, (size_type)cl.get_compute_units() * 4);
+		cl::Buffer partial_sums = cl.GPU_buffer<T>(num_groups * kd), partial_counts = cl.GPU_buffer<cl_uint>(num_groups * k);
+		const std::shared_ptr<const T> zero_sum = std::make_shared<T>(0);
+		const std::shared_ptr<const cl_uint> zero_count = std::make_shared<cl_uint>(0);
+		cl::Buffer counts = cl.GPU_buffer<cl_uint>(k, 0), status = cl.GPU_buffer<cl_uint>(3, 0);
+		cl::Kernel combine_kernel = kmeans_kernel<T>("opencl_kmeans_combine", privatized);
+		cl::Kernel check_kernel = kmeans_kernel<T>("opencl_kmeans_check", privatized);
+		Scalar<bool> converged(false);
+		
+		kmeans_result<T> result;
+		result.assignments = Vector<unsigned int>(num_points, 0xFFFFFFFFu);
+		loop_until(converged, max_iterations, [&]() {
+			// without privatization the work-groups accumulate straight into their slices
+			if (!privatized) {
+				cl.fill_buffer(partial_sums, zero_sum, sizeof(T), num_groups * kd * sizeof(T));
+				cl.fill_buffer(partial_counts, zero_count, sizeof(cl_uint), num_groups * k * sizeof(cl_uint));
+			}
+			const size_type local_elements = privatized ? kd : 1;
+			cl.enqueue_kernel(step_kernel, num_groups * local_size, local_size, points, centroids, result.assignments.data, partial_sums,
+			                  partial_counts, status, converged.data, cl::Local(local_elements * sizeof(T)), cl::Local(local_elements * sizeof(T)),
+			                  cl::Local((privatized ? k : 1) * sizeof(cl_uint)), std::numeric_limits<T>::max(), (cl_uint)k, (cl_uint)dims, (cl_ulong)num_points);
+			cl.enqueue_kernel(combine_kernel, k, config.local_size, partial_sums, partial_counts, centroids, counts, status, converged.data,
+			                  tolerance * tolerance, (cl_uint)k, (cl_uint)dims, (cl_uint)num_groups);
+			cl.enqueue_kernel(check_kernel, 1, 0, status, converged.data);
+		});
+		
+		result.iterations = cl.get_GPU_buffer_index<cl_uint>(status, 2);
+		result.converged = converged.get();
+		result.centroids.resize(kd);
+		cl.from_GPU_buffer(centroids, 0, result.centroids);
+		std::vector<cl_uint> host_counts(k);
+		cl.from_GPU_buffer(counts, 0, host_counts);
+		result.counts.assign(host_counts.begin(), host_counts.end());
+		return result;
+	}
+	
+	// DISTANCES AND NEAREST NEIGHBOURS
+	enum distance_metric {l2_distance, l1_distance, cosine_distance};
+	
+	// kernel code leaving the distance between the points whose coordinate d is q and r in distance,
+	// squared for l2_distance when squared is set
+	static std::string distance_code(enum distance_metric metric, const std::string & T_s, const std::string & q, const std::string & r, bool squared) {
+		std::string code =
+			"			" + T_s + " distance = 0, qq = 0, rr = 0;\n"
+			"			for (uint d = 0; d < dims; ++d) {\n"
+			"				const " + T_s + " qv = " + q + ", rv = " + r + ";\n";
+		if (metric == l2_distance) code += "				distance += (qv - rv) * (qv - rv);\n";
+		else if (metric == l1_distance) code += "				distance += fabs(qv - rv);\n";
+		else code += "				distance += qv * rv;\n"
+		             "				qq += qv * qv;\n"
+		             "				rr += rv * rv;\n";
+		code += "			}\n";
+		if (metric == cosine_distance) code += "			distance = qq > 0 && rr > 0 ? 1 - distance / sqrt(qq * rr) : 1;\n";
+		if (metric == l2_distance && !squared) code += "			distance = sqrt(distance);\n";
+		return code;
+	}
+	
+	// work-group size for kernels keeping dims coordinates of tiles_per_group tiles in local memory, halved
+	// until the tiles fit next to the kernel's own local memory with the usual headroom
+	template<typename T>
+	size_type distance_tile_size(cl::Kernel & kernel, size_type dims, size_type tiles_per_group) {
+		const char *T_str = typeToStr<T>();
+		const launch_config config = cl.get_tuning(tuning_key("distance", &T_str, 1, -1));
+		size_type tile = cl.work_group_size(kernel, config.local_size ? config.local_size : 64);
+		while (tile > 1 && !cl.fits_local_memory(kernel, tile * dims * tiles_per_group * sizeof(T))) tile /= 2;
+		if (!cl.fits_local_memory(kernel, tile * dims * tiles_per_group * sizeof(T))) throw "too many dimensions for local memory";
+		return tile;
+	}
+	
+	// distances from every query to every reference, with those of query q at q * references + r; each
+	// work-item handles one reference and the queries are streamed through local memory a tile at a time
+	template<typename T>
+	Vector<T> pairwise_distances(const std::vector<const Vector<T>*> & queries, const std::vector<const Vector<T>*> & references,
+	                             enum distance_metric metric = l2_distance) {
+		if (!std::is_same<T, float>::value && !std::is_same<T, double>::value) throw "distances require float or double points";
+		const size_type dims = queries.size();
+		if (dims == 0 || references.size() != dims) throw "queries and references need the same number of dimensions";
+		const std::string T_s = typeToStr<T>();
+		const std::string kernel_code =
+			"__kernel void opencl_pairwise(global " + T_s + " *queries, global " + T_s + " *references, global " + T_s + " *out, "
+			"local " + T_s + " *query_tile, const uint dims, const unsigned long num_queries, const unsigned long num_references) \n"
+			"{\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0);\n"
+			"	const unsigned long r = get_global_id(0);\n"
+			"	for (unsigned long tile = 0; tile < num_queries; tile += n) {\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		if (tile + lid < num_queries) {\n"
+			"			for (uint d = 0; d < dims; ++d) query_tile[d * n + lid] = queries[d * num_queries + tile + lid];\n"
+			"		}\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		if (r >= num_references) continue;\n"
+			"		const uint tile_size = min((unsigned long)n, num_queries - tile);\n"
+			"		for (uint j = 0; j < tile_size; ++j) {\n"
+			+ distance_code(metric, T_s, "query_tile[d * n + j]", "references[d * num_references + r]", false) +
+			"			out[(tile + j) * num_references + r] = distance;\n"
+			"		}\n"
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_pairwise");
+		cl::Buffer query_points = pack_columns<T>(queries), reference_points = pack_columns<T>(references);
+		const size_type num_queries = queries.front()->size(), num_references = references.front()->size();
+		Vector<T> output(num_queries * num_references > 0 ? num_queries * num_references : 1);
+		if (num_queries * num_references == 0) {
+			output.resize(0);
+			return output;
+		}
+		const size_type tile = distance_tile_size<T>(kernel, dims, 1);
+		cl.enqueue_kernel(kernel, num_references, tile, query_points, reference_points, output.data, cl::Local(tile * dims * sizeof(T)),
+		                  (cl_uint)dims, (cl_ulong)num_queries, (cl_ulong)num_references);
+		return output;
+	}
+	
+	// the k nearest references of each query, closest first, with those of query q at q * k + j
+	template<typename T>
+	struct knn_result {
+		Vector<unsigned int> indices;
+		Vector<T> distances;
+	};
+	
+	// each work-item keeps the k best references of one query in private memory, while the queries of its
+	// work-group and a tile of references at a time sit in local memory, so no distance matrix is stored
+	template<typename T>
+	knn_result<T> nearest_neighbors(const std::vector<const Vector<T>*> & queries, const std::vector<const Vector<T>*> & references,
+	                                size_type k, enum distance_metric metric = l2_distance) {
+		if (!std::is_same<T, float>::value && !std::is_same<T, double>::value) throw "distances require float or double points";
+		const size_type dims = queries.size();
+		if (dims == 0 || references.size() != dims) throw "queries and references need the same number of dimensions";
+		const size_type num_queries = queries.front()->size(), num_references = references.front()->size();
+		if (k == 0 || k > 64 || k > num_references) throw "nearest_neighbors requires between 1 and 64 neighbours, and no more than the references";
+		const std::string T_s = typeToStr<T>(), K = std::to_string(k);
+		const std::string kernel_code =
+			"__kernel void opencl_knn(global " + T_s + " *queries, global " + T_s + " *references, global uint *indices, global " + T_s + " *distances, "
+			"local " + T_s + " *query_tile, local " + T_s + " *reference_tile, const uint dims, const unsigned long num_queries, const unsigned long num_references) \n"
+			"{\n"
+			"	const size_t lid = get_local_id(0), n = get_local_size(0);\n"
+			"	const unsigned long q = get_global_id(0);\n"
+			"	for (uint d = 0; d < dims; ++d) query_tile[d * n + lid] = q < num_queries ? queries[d * num_queries + q] : 0;\n"
+			"	" + T_s + " best_distances[" + K + "];\n"
+			"	uint best_indices[" + K + "];\n"
+			"	for (uint j = 0; j < " + K + "; ++j) {\n"
+			"		best_distances[j] = INFINITY;\n"
+			"		best_indices[j] = 0;\n"
+			"	}\n"
+			"	for (unsigned long tile = 0; tile < num_references; tile += n) {\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		if (tile + lid < num_references) {\n"
+			"			for (uint d = 0; d < dims; ++d) reference_tile[d * n + lid] = references[d * num_references + tile + lid];\n"
+			"		}\n"
+			"		barrier(CLK_LOCAL_MEM_FENCE);\n"
+			"		const uint tile_size = min((unsigned long)n, num_references - tile);\n"
+			"		for (uint j = 0; j < tile_size; ++j) {\n"
+			+ distance_code(metric, T_s, "query_tile[d * n + lid]", "reference_tile[d * n + j]", true) +
+			"			if (distance < best_distances[" + K + " - 1]) {\n"
+			"				uint p = " + K + " - 1;\n"
+			"				for (; p > 0 && best_distances[p - 1] > distance; --p) {\n"
+			"					best_distances[p] = best_distances[p - 1];\n"
+			"					best_indices[p] = best_indices[p - 1];\n"
+			"				}\n"
+			"				best_distances[p] = distance;\n"
+			"				best_indices[p] = tile + j;\n"
+			"			}\n"
+			"		}\n"
+			"	}\n"
+			"	if (q >= num_queries) return;\n"
+			"	for (uint j = 0; j < " + K + "; ++j) {\n"
+			"		indices[q * " + K + " + j] = best_indices[j];\n"
+			"		distances[q * " + K + " + j] = " + (metric == l2_distance ? "sqrt(best_distances[j])" : "best_distances[j]") + ";\n"
+			"	}\n"
+			"}";
+		cl::Kernel kernel = cl.get_kernel(kernel_code, "opencl_knn");
+		if (num_references >= 0xFFFFFFFFul) throw "Vector too large to search";
+		cl::Buffer query_points = pack_columns<T>(queries), reference_points = pack_columns<T>(references);
+		knn_result<T> result;
+		result.indices = Vector<unsigned int>(num_queries > 0 ? num_queries * k : 1);
+		result.distances = Vector<T>(num_queries > 0 ? num_queries * k : 1);
+		if (num_queries == 0) {
+			result.indices.resize(0);
+			result.distances.resize(0);
+			return result;
+		}
+		const size_type tile = distance_tile_size<T>(kernel, dims, 2);
+		cl.enqueue_kernel(kernel, num_queries, tile, query_points, reference_points, result.indices.data, result.distances.data,
+		                  cl::Local(tile * dims * sizeof(T)), cl::Local(tile * dims * sizeof(T)), (cl_uint)dims, (cl_ulong)num_queries, (cl_ulong)num_references);
+		return result;
+	}
+	
 	template<typename T>
 	Vector<T> indices_Vector(size_type size) {
 		Vector<T> output(size);
 		parallel_indices<T>(output.data, size);
 		return output;
 	}
+	
+	// runs launch once to compile its kernels, then returns the best wall-clock time of a few runs in seconds
+	// (infinity if the launch parameters are rejected by the device)
+	template<class launch_type>
+	double time_launch(launch_type launch) {
+		double best = std::numeric_limits<double>::infinity();
+		try {
+			launch();
+			cl.sync();
+			for (unsigned run = 0; run < 3; ++run) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				launch();
+				cl.sync();
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				best = std::min(best, elapsed.count());
+			}
+		} catch (...) {
+			return std::numeric_limits<double>::infinity();
+		}
+		return best;
+	}
+	
+	// benchmarks candidate work-group sizes, coarsening factors and reduction fan-outs for the kernels of
+	// type T on the current device, keeps the fastest ones and saves them to the tuning profile
+	template<typename T>
+	void autotune(size_type test_size = 1 << 22) {
+		static const size_type local_sizes[] = {0, 32, 64, 128, 256};
+		static const unsigned coarsenings[] = {1, 2, 4, 8};
+		static const unsigned reduction_amounts[] = {16, 32, 64, 128, 256};
+		static const size_type reduction_thresholds[] = {1000, 10000, 100000};
+		static const enum operation compute_ops[] = {plus, minus, times, divide, copy};
+		static const enum reduce_operation reduce_ops[] = {reduce_plus, reduce_times};
+		const char* const T_str = typeToStr<T>();
+		const char* const types[] = {T_str, T_str, T_str};
+		Vector<T> a(test_size, (T)1), b(test_size, (T)1), c(test_size);
+		Vector<bool> mask(test_size, true);
+		
+		// elementwise operations
+		for (enum operation op : compute_ops) {
+			const unsigned num_operands = (op == copy) ? 2 : 3;
+			const std::string key = tuning_key("compute", types, num_operands, op);
+			launch_config best;
+			double best_time = std::numeric_limits<double>::infinity();
+			for (size_type local_size : local_sizes) {
+				for (unsigned coarsening : coarsenings) {
+					const launch_config config(local_size, coarsening);
+					cl.set_tuning(key, config);
+					double time = time_launch([&]() {
+						if (op == copy) parallel_compute<T, T>(a.data, c.data, test_size, op);
+						else parallel_compute<T, T, T>(a.data, b.data, c.data, test_size, op);
+					});
+					if (time < best_time) {
+						best_time = time;
+						best = config;
+					}
+				}
+			}
+			cl.set_tuning(key, best);
+			if (op == plus) cl.set_tuning(tuning_key("compute", types, 1, -1), best);
+		}
+		
+		// reductions
+		for (enum reduce_operation op : reduce_ops) {
+			const std::string key = tuning_key("reduce", types, 1, op);
+			launch_config best;
+			double best_time = std::numeric_limits<double>::infinity();
+			for (size_type local_size : local_sizes) {
+				for (unsigned reduction_amount : reduction_amounts) {
+					for (size_type reduction_threshold : reduction_thresholds) {
+						const launch_config config(local_size, 1, reduction_amount, reduction_threshold);
+						cl.set_tuning(key, config);
+						double time = time_launch([&]() { parallel_reduce<T>(a.data, test_size, op); });
+						if (time < best_time) {
+							best_time = time;
+							best = config;
+						}
+					}
+				}
+			}
+			cl.set_tuning(key, best);
+		}
+		
+		// filter
+		const std::string key = tuning_key("filter", types, 1, -1);
+		launch_config best;
+		double best_time = std::numeric_limits<double>::infinity();
+		for (size_type local_size : local_sizes) {
+			const launch_config config(local_size);
+			cl.set_tuning(key, config);
+			double time = time_launch([&]() { parallel_filter<T>(a.data, mask.data, c.data, test_size); });
+			if (time < best_time) {
+				best_time = time;
+				best = config;
+			}
+		}
+		cl.set_tuning(key, best);
+		
+		if (!cl.save_tuning()) throw "error writing tuning profile";
+	}
 }
\ No newline at end of file
@@ -13,19 +13,21 @@ int main(int argc, char *argv[]) {
 	// determine bound on numbers to search through
 	const size_t bound = (size_t)(sqrt((double)key) + 1);
 	
-	// initialize ParallelVector constants
-	PV::Vector<size_t> zeros(bound-1, 0);
-	PV::Vector<size_t> twos(bound-1, 2);
-	PV::Vector<size_t> keys(bound-1, key);
+	// constants and all numbers from 2 to bound, generated inside the kernels instead of stored
+	PV::Generator<size_t> zeros = PV::constant<size_t>(bound-1, 0);
+	PV::Generator<size_t> keys = PV::constant<size_t>(bound-1, key);
+	PV::Generator<size_t> nums = PV::iota<size_t>(bound-1, 2);
 	
-	// get all numbers from 2 to bound
-	PV::Vector<size_t> nums = PV::indices_Vector<size_t>(bound-1) + twos;
-	
-	// find number that evenly divides key via brute force
-	PV::Vector<size_t> result = nums.filterBy(keys % nums == zeros);
+	// find number that evenly divides key via brute force, stopping at the first one; the remainders and
+	// their comparison with zero are computed inside the search kernel and never stored
+	const size_t index = PV::find_first(PV::compare_eq(PV::modulo(keys, nums), zeros));
+	if (index == nums.size()) {
+		printf("No divisor found\n");
+		return 1;
+	}
 	
 	// generate the original primes
-	const size_t result_prime_1 = result[0];
+	const size_t result_prime_1 = nums[index];
 	const size_t result_prime_2 = key / result_prime_1;
 	
 	printf("Original primes: %zu, %zu\n", prime_1, prime_2);
@@ -6,7 +6,7 @@
 
 int main(int argc, char *argv[]) {
 	const unsigned num_points = 1000000;
-	const unsigned num_iterations = 10;
+	const unsigned max_iterations = 100;
 	
 	// generate random points
 	std::vector<float> std_points_X(num_points);
@@ -18,47 +18,60 @@ int main(int argc, char *argv[]) {
 		std_points_Y[i] = (float)rand() / (float)RAND_MAX;
 	}
 	
-	// initialize centroids to two first points
-	float centroid1_X = std_points_X[0];
-	float centroid1_Y = std_points_Y[0];
-	float centroid2_X = std_points_X[1];
-	float centroid2_Y = std_points_Y[1];
+	// distances only decide cluster membership, so relaxed float math is acceptable
+	PV::math_mode fast_math(PV::math_mode::mad_enable | PV::math_mode::no_signed_zeros);
 	
 	// import point data into ParallelVector
 	PV::Vector<float> points_X(std_points_X);
 	PV::Vector<float> points_Y(std_points_Y);
 	
-	for (unsigned itteration = 0; itteration < num_iterations; ++itteration) {
-		printf("itteration %d\n", itteration + 1);
-		printf("centroid 1 starting location: (%g, %g)\n", centroid1_X, centroid1_Y);
-		printf("centroid 2 starting location: (%g, %g)\n", centroid2_X, centroid2_Y);
-		
-		// import centroid data into ParallelVector
-		PV::Vector<float> centroid1_X_vec(num_points, centroid1_X);
-		PV::Vector<float> centroid1_Y_vec(num_points, centroid1_Y);
-		PV::Vector<float> centroid2_X_vec(num_points, centroid2_X);
-		PV::Vector<float> centroid2_Y_vec(num_points, centroid2_Y);
-		
+	// initialize centroids to two first points, kept on the device between iterations
+	PV::Scalar<float> centroid1_X(std_points_X[0]);
+	PV::Scalar<float> centroid1_Y(std_points_Y[0]);
+	PV::Scalar<float> centroid2_X(std_points_X[1]);
+	PV::Scalar<float> centroid2_Y(std_points_Y[1]);
+	
+	// iterate until the centroids stop moving, with the convergence check read back in the background
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	PV::Scalar<bool> converged(false);
+	PV::Scalar<float> tolerance(1e-10f);
+	PV::size_type iterations = PV::loop_until(converged, max_iterations, [&]() {
 		// calculate squared distances from points to both centroids
-		PV::Vector<float> distance1 = (points_X - centroid1_X_vec) * (points_X - centroid1_X_vec) +
-		                              (points_Y - centroid1_Y_vec) * (points_Y - centroid1_Y_vec);
-		PV::Vector<float> distance2 = (points_X - centroid2_X_vec) * (points_X - centroid2_X_vec) +
-		                              (points_Y - centroid2_Y_vec) * (points_Y - centroid2_Y_vec);
+		PV::Vector<float> distance1 = (points_X - centroid1_X) * (points_X - centroid1_X) +
+		                              (points_Y - centroid1_Y) * (points_Y - centroid1_Y);
+		PV::Vector<float> distance2 = (points_X - centroid2_X) * (points_X - centroid2_X) +
+		                              (points_Y - centroid2_Y) * (points_Y - centroid2_Y);
 		
-		// get points closest to each centroid
-		PV::Vector<float> points1_X = points_X.filterBy(distance1 < distance2);
-		PV::Vector<float> points1_Y = points_Y.filterBy(distance1 < distance2);
-		PV::Vector<float> points2_X = points_X.filterBy(distance1 >= distance2);
-		PV::Vector<float> points2_Y = points_Y.filterBy(distance1 >= distance2);
+		// get new coordinates for each centroid from the points closest to it, in single masked passes
+		// that never read anything back to the host
+		PV::Scalar<float> new1_X = points_X.mean_where_scalar(PV::compare_lt(distance1, distance2));
+		PV::Scalar<float> new1_Y = points_Y.mean_where_scalar(PV::compare_lt(distance1, distance2));
+		PV::Scalar<float> new2_X = points_X.mean_where_scalar(PV::compare_ge(distance1, distance2));
+		PV::Scalar<float> new2_Y = points_Y.mean_where_scalar(PV::compare_ge(distance1, distance2));
 		
-		// get new coordinates for each centroid
-		centroid1_X = points1_X.sum() / points1_X.size();
-		centroid1_Y = points1_Y.sum() / points1_Y.size();
-		centroid2_X = points2_X.sum() / points2_X.size();
-		centroid2_Y = points2_Y.sum() / points2_Y.size();
-	}
+		// squared distance the centroids moved
+		PV::Scalar<float> dx1 = new1_X - centroid1_X, dy1 = new1_Y - centroid1_Y;
+		PV::Scalar<float> dx2 = new2_X - centroid2_X, dy2 = new2_Y - centroid2_Y;
+		converged = dx1 * dx1 + dy1 * dy1 + dx2 * dx2 + dy2 * dy2 < tolerance;
+		
+		centroid1_X = new1_X;
+		centroid1_Y = new1_Y;
+		centroid2_X = new2_X;
+		centroid2_Y = new2_Y;
+	});
+	PV::cl.sync();
+	const double example_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("finished after %d itterations\n", (int)iterations);
 	
 	// print out final centroid coordinates
-	printf("centroid 1 final location: (%g, %g)\n", centroid1_X, centroid1_Y);
-	printf("centroid 2 final location: (%g, %g)\n", centroid2_X, centroid2_Y);
-}
\ No newline at end of file
+	printf("centroid 1 final location: (%g, %g)\n", centroid1_X.get(), centroid1_Y.get());
+	printf("centroid 2 final location: (%g, %g)\n", centroid2_X.get(), centroid2_Y.get());
+	
+	// the same clustering with the general PV::kmeans module, which also handles any k and dimensionality
+	start = std::chrono::steady_clock::now();
+	PV::kmeans_result<float> clusters = PV::kmeans<float>({&points_X, &points_Y}, 2, max_iterations, 1e-5f);
+	const double module_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("PV::kmeans finished after %d itterations\n", (int)clusters.iterations);
+	printf("PV::kmeans centroids: (%g, %g) and (%g, %g)\n", clusters.centroids[0], clusters.centroids[1], clusters.centroids[2], clusters.centroids[3]);
+	printf("example: %g s, PV::kmeans: %g s\n", example_time, module_time);
+}
@@ -2,9 +2,32 @@
 
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <cmath>
 #include <assert.h>
 #include "ParallelVector.hpp"
 
+#if defined(__cpp_impl_coroutine)
+#include <future>
+
+// coroutine that starts immediately and is not awaited itself, used to test co_await on PV::Future
+struct detached_task {
+	struct promise_type {
+		detached_task get_return_object() { return detached_task(); }
+		std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+		std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+// reports the awaited value and the thread the coroutine resumed on
+detached_task await_value(PV::Future<int> future, std::promise<std::pair<int, std::thread::id>> & result) {
+	const int value = co_await future;
+	result.set_value(std::make_pair(value, std::this_thread::get_id()));
+}
+#endif
+
 int main(int argc, char *argv[]) {
 	try {
 		const unsigned test_size = 25000000;
@@ -199,6 +222,19 @@ int main(int argc, char *argv[]) {
 			assert(test13[12] == 0);
 		}
 		
+		// test element counts that leave a partial vector at the end
+		{
+			PV::Vector<char> test1(test_size + 3, 1);
+			PV::Vector<char> test2 = test1 + test1;
+			assert(test2[0] == 2);
+			assert(test2.back() == 2);
+			PV::Vector<short> test3(test_size + 1, 3);
+			PV::Vector<short> test4 = -test3;
+			assert(test4.back() == -3);
+			PV::Vector<bool> test5 = test1 == test1;
+			assert(test5.back() == true);
+		}
+		
 		// test reductions and rotations
 		{
 			PV::Vector<int> zeros(test_size, 0);
@@ -251,6 +287,508 @@ int main(int argc, char *argv[]) {
 
 		}
 		
+		// test shared virtual memory storage (skipped on devices without fine-grained SVM)
+		if (PV::cl.set_storage_mode(PV::svm_storage)) {
+			std::vector<int> nums(test_size, 1);
+			PV::Vector<int> ones(nums);
+			assert(ones.is_shared());
+			PV::Vector<int> twos(test_size, 2);
+			assert(twos[0] == 2);
+			PV::Vector<int> threes = ones + twos;
+			assert(threes.is_shared());
+			assert(threes.front() == 3);
+			assert(threes.back() == 3);
+			threes.set(1, 4);
+			assert(threes.get(1) == 4);
+			assert(threes.sum() == 3 * test_size + 1);
+			threes.push_back(5);
+			assert(threes.back() == 5);
+			PV::cl.set_storage_mode(PV::buffer_storage);
+			PV::Vector<int> buffered(test_size, 1);
+			assert(!buffered.is_shared());
+		}
+		
+		// test compiler options
+		{
+			PV::cl.set_build_options("");
+			PV::Vector<float> halves(test_size, 0.5f);
+			{
+				PV::math_mode fast_math(PV::math_mode::fast);
+				assert(PV::cl.get_build_options() == "-cl-fast-relaxed-math");
+				PV::Vector<float> ones = halves + halves;
+				assert(ones[0] == 1.0f);
+				{
+					PV::build_options mad("-cl-mad-enable");
+					assert(PV::cl.get_build_options() == "-cl-fast-relaxed-math -cl-mad-enable");
+				}
+				assert(PV::cl.get_build_options() == "-cl-fast-relaxed-math");
+			}
+			assert(PV::cl.get_build_options().empty());
+			PV::Vector<float> quarters = halves * halves;
+			assert(quarters[1] == 0.25f);
+		}
+		
+		// test concurrent use from several threads
+		{
+			const int num_threads = 4;
+			const unsigned thread_size = 1 << 20;
+			std::vector<std::thread> threads;
+			std::vector<int> sums(num_threads);
+			for (int t = 0; t < num_threads; ++t) {
+				threads.push_back(std::thread([t, thread_size, &sums]() {
+					PV::Vector<int> nums(thread_size, t);
+					PV::Vector<int> doubled = nums + nums;
+					sums[t] = doubled.sum();
+				}));
+			}
+			for (std::thread & thread : threads) thread.join();
+			for (int t = 0; t < num_threads; ++t) assert(sums[t] == 2 * t * (int)thread_size);
+		}
+		
+		// test streams
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Stream stream1, stream2;
+			PV::Vector<int> twos, threes;
+			{
+				PV::stream_scope scope(stream1);
+				twos = ones + ones;
+			}
+			stream2.run([&]() {
+				assert(twos[0] == 2);
+				threes = twos + ones;
+			});
+			assert(twos[0] == 2);
+			assert(threes.back() == 3);
+			PV::Vector<int> fives = twos + threes;
+			assert(fives.sum() == 5 * test_size);
+			stream1.wait(stream2);
+			stream1.synchronize();
+			// a scope does not wait for a sibling scope of the same thread that is still running
+			cl::UserEvent gate(PV::cl.get_GPU_context());
+			PV::Vector<int> gated, ungated;
+			stream1.run([&]() {
+				stream1.wait(gate);
+				gated = ones + ones;
+			});
+			stream2.run([&]() { ungated = ones + ones + ones; });
+			cl::Event ungated_done = stream2.record();
+			stream2.queue().flush();
+			const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			while (ungated_done.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+			const bool overlapped = ungated_done.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE;
+			gate.setStatus(CL_COMPLETE);
+			assert(overlapped);
+			assert(gated[0] == 2 && ungated.back() == 3);
+		}
+		
+		// test autotuning and the tuning profile
+		{
+			PV::cl.set_tuning_file("tests.tuning");
+			PV::autotune<int>(1 << 16);
+			PV::Vector<int> ones(test_size, 1);
+			PV::Vector<int> twos = ones + ones;
+			assert(twos.back() == 2);
+			assert(twos.sum() == 2 * test_size);
+			PV::cl.set_tuning_file("tests.tuning");
+			assert(PV::cl.load_tuning("tests.tuning"));
+			PV::Vector<int> threes = twos + ones;
+			assert(threes[test_size / 2] == 3);
+			PV::autotune<unsigned>(1 << 16);
+			PV::cl.set_tuning("compute unsigned int *", PV::launch_config(32, 4));
+			const PV::launch_config fallback = PV::cl.get_tuning("compute unsigned int,unsigned int,bool 99");
+			assert(fallback.local_size == 32 && fallback.coarsening == 4);
+			assert(PV::cl.get_tuning("compute float,float,bool 10").coarsening == PV::bool_output_coarsening);
+			assert(PV::cl.get_tuning("compute float,float,float 0").coarsening == 1);
+			PV::Vector<float> halves(test_size + 3, 0.5f);
+			assert((halves < PV::Vector<float>(test_size + 3, 1.0f)).count() == test_size + 3);
+			PV::Vector<unsigned> unsigned_twos = PV::Vector<unsigned>(test_size, 1) + PV::Vector<unsigned>(test_size, 1);
+			assert(unsigned_twos.sum() == 2 * test_size);
+			remove("tests.tuning");
+		}
+		
+		// test capturing and launching graphs
+		{
+			PV::graph_param<int> step(1);
+			PV::Vector<int> twos(test_size, 2);
+			PV::Vector<int> result;
+			PV::Graph graph;
+			graph.capture([&]() {
+				PV::Vector<int> steps(test_size, step);
+				result = twos * steps + steps;
+			});
+			assert(graph.size() > 0);
+			graph.launch();
+			assert(result[0] == 3);
+			step.set(4);
+			graph.launch();
+			assert(result.back() == 12);
+			bool host_access_failed = false;
+			try {
+				graph.capture([&]() { result[0]; });
+			} catch (char const * error) {
+				host_access_failed = true;
+			}
+			assert(host_access_failed);
+		}
+		
+		// test asynchronous reductions and reads
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Future<int> ones_sum = ones.sum_async();
+			PV::Future<int> twos_sum = (ones + ones).sum_async();
+			PV::Future<int> last = indices.get_async(test_size - 1);
+			PV::Future<PV::Vector<int>> evens = indices.filterBy_async(indices % PV::Vector<int>(test_size, 2) == PV::Vector<int>(test_size, 0));
+			assert(ones_sum.valid());
+			assert(twos_sum.get() == 2 * test_size);
+			assert(ones_sum.get() == test_size);
+			assert(last.get() == test_size - 1);
+			PV::Vector<int> filtered = evens.get();
+			assert(filtered.size() == (test_size + 1) / 2);
+		}
+		
+#if defined(__cpp_impl_coroutine)
+		// test awaiting Futures from coroutines
+		{
+			PV::Vector<int> ones(test_size, 1);
+			std::promise<std::pair<int, std::thread::id>> awaited;
+			std::future<std::pair<int, std::thread::id>> awaited_result = awaited.get_future();
+			await_value(ones.sum_async(), awaited);
+			assert(awaited_result.get().first == test_size);
+			
+			// a Future that is already ready does not suspend, so the coroutine continues on this thread
+			PV::Future<int> ready_sum = ones.sum_async();
+			ready_sum.wait();
+			std::promise<std::pair<int, std::thread::id>> ready;
+			std::future<std::pair<int, std::thread::id>> ready_result = ready.get_future();
+			await_value(ready_sum, ready);
+			const std::pair<int, std::thread::id> inline_result = ready_result.get();
+			assert(inline_result.first == test_size);
+			assert(inline_result.second == std::this_thread::get_id());
+		}
+#endif
+		
+		// test device-resident scalars
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Scalar<int> count = ones.sum_scalar();
+			PV::Scalar<int> half = count / PV::Scalar<int>(2);
+			PV::Vector<int> shifted = ones * half + count;
+			assert(shifted[0] == test_size / 2 + test_size);
+			assert(half.get() == test_size / 2);
+			assert((count - half).get_async().get() == test_size - test_size / 2);
+			assert(PV::indices_Vector<int>(5).product_scalar().get() == 0);
+		}
+		
+		// test device-side convergence loops
+		{
+			PV::Scalar<int> count(0), one(1), target(5);
+			PV::Scalar<bool> converged(false);
+			PV::size_type iterations = PV::loop_until(converged, 100, [&]() {
+				count = count + one;
+				converged = count >= target;
+			});
+			assert(iterations >= 5 && iterations <= 5 + 4);
+			assert(count.get() == (int)iterations);
+			PV::Scalar<bool> never(false);
+			assert(PV::loop_until(never, 3, []() {}) == 3);
+		}
+		
+		// test copy-on-write sharing of copies
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Vector<int> copy1 = ones;
+			PV::Vector<int> copy2(ones);
+			assert(copy1.data() == ones.data());
+			copy1.set(0, 5);
+			assert(copy1.data() != ones.data());
+			assert(copy1[0] == 5 && ones[0] == 1 && copy2[0] == 1);
+			PV::Vector<int> old = copy2++;
+			assert(old.back() == 1 && copy2.back() == 2 && ones.back() == 1);
+			copy2 += ones;
+			assert(copy2[1] == 3 && ones[1] == 1);
+			ones.push_back(7);
+			assert(ones.size() == test_size + 1 && copy2.size() == test_size);
+		}
+		
+		// test moves and buffer reuse by expiring operands
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Vector<int> twos = ones + ones;
+			cl_mem twos_buffer = twos.data();
+			PV::Vector<int> threes = std::move(twos) + ones;
+			assert(threes.data() == twos_buffer);
+			assert(threes[0] == 3);
+			PV::Vector<int> moved(std::move(threes));
+			assert(moved.data() == twos_buffer);
+			PV::Vector<int> chained = (ones + ones) * (ones + ones) - ones;
+			assert(chained.back() == 3);
+			twos = ones + ones;
+			assert(twos.sum() == 2 * test_size);
+			PV::Vector<int> copy = chained;
+			PV::Vector<int> negated = -std::move(chained);
+			assert(negated[0] == -3 && copy[0] == 3);
+		}
+		
+		// test destination-passing operations
+		{
+			PV::Vector<int> ones(test_size, 1);
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> out(test_size);
+			PV::Vector<bool> mask(test_size);
+			cl_mem out_buffer = out.data();
+			PV::add(indices, ones, out);
+			assert(out[0] == 1 && out.back() == test_size);
+			out.assign(PV::multiply(out, ones));
+			assert(out[1] == 2);
+			PV::compare_lt(indices, ones, mask);
+			assert(mask[0] && !mask[1]);
+			out.assign(ones);
+			assert(out.back() == 1 && out.data() == out_buffer);
+			bool size_mismatch = false;
+			try {
+				PV::subtract(ones, PV::Vector<int>(5u), out);
+			} catch (char const * error) {
+				size_mismatch = true;
+			}
+			assert(size_mismatch);
+		}
+		
+		// test generators
+		{
+			PV::Generator<int> threes = PV::constant<int>(test_size, 3);
+			PV::Generator<int> odds = PV::iota<int>(test_size, 1, 2);
+			PV::Vector<int> ones(test_size, 1);
+			assert(odds[2] == 5 && odds.size() == test_size);
+			PV::Vector<int> sums = odds + threes;
+			assert(sums[0] == 4 && sums.back() == 2 * (int)test_size + 2);
+			PV::Vector<int> evens = ones + odds;
+			assert(evens[3] == 8);
+			PV::Vector<bool> small = odds < ones + ones + ones + ones;
+			assert(small[1] && !small[2]);
+			PV::Vector<int> materialized = odds.materialize();
+			assert(materialized[10] == 21);
+			assert(PV::iota<int>(1000, 1, 2).materialize().sum() == 1000 * 1000);
+			PV::Vector<float> steps = PV::linspace<float>(5, 0.0f, 1.0f).materialize();
+			assert(steps[4] == 1.0f && steps[2] == 0.5f);
+		}
+		
+		// test early-exit searches and counts
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> limits(test_size, 1000);
+			PV::Vector<bool> large = indices > limits;
+			assert(large.find_first() == 1001);
+			assert(large.any() && !large.all());
+			assert(large.count() == test_size - 1001);
+			assert(PV::find_first(PV::compare_ge(indices, limits)) == 1000);
+			assert(PV::any(PV::compare_eq(indices, limits)));
+			assert(PV::all(PV::compare_ge(indices, PV::Vector<int>(test_size, 0))));
+			assert(!PV::any(PV::compare_lt(indices, PV::Vector<int>(test_size, 0))));
+			assert(PV::count_if(PV::compare_lt(indices, limits)) == 1000);
+			PV::Generator<int> divisors = PV::iota<int>(test_size, 2);
+			assert(PV::find_first(PV::compare_eq(PV::modulo(PV::constant<int>(test_size, 91), divisors), PV::constant<int>(test_size, 0))) == 5);
+			assert(PV::count_if(PV::compare_lt(PV::iota<int>(test_size), PV::constant<int>(test_size, 1000))) == 1000);
+			assert(PV::all(PV::compare_gt(PV::add(divisors, divisors), PV::constant<int>(test_size, 3))));
+			assert(!PV::any(PV::compare_eq(PV::modulo(PV::constant<int>(test_size, 1), divisors), PV::constant<int>(test_size, 0))));
+			assert(PV::Vector<bool>(test_size, false).find_first() == test_size);
+		}
+		
+		// test filtering with a fused predicate
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> limits(test_size, 1000);
+			PV::Vector<int> small = indices.filterBy(PV::compare_lt(indices, limits));
+			assert(small.size() == 1000);
+			assert(small.sum() == 999 * 1000 / 2);
+			PV::Vector<int> large = indices.filterBy(PV::compare_ge(indices, limits));
+			assert(large.size() == indices.filterBy(indices >= limits).size());
+		}
+		
+		// test filtering several columns with one mask
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> doubled = indices * PV::Vector<int>(test_size, 2);
+			PV::Vector<int> limits(test_size, 1000);
+			PV::Vector<bool> mask = indices < limits;
+			PV::filter_columns(mask, {&indices, &doubled});
+			assert(indices.size() == 1000 && doubled.size() == 1000);
+			assert(indices[999] == 999 && doubled[999] == 1998);
+			assert(doubled.sum() == 2 * indices.sum());
+			const size_t n = 10;
+			PV::Vector<int> a(n, 1), b(n, 2), c(n, 3), d(n, 4), e(n, 5);
+			PV::Vector<bool> none = a > PV::Vector<int>(n, 1);
+			PV::filter_columns(none, {&a, &b, &c, &d, &e});
+			assert(a.size() == 0 && e.size() == 0);
+		}
+		
+		// test partitioning
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> limits(test_size, 1000);
+			std::pair<PV::Vector<int>, PV::Vector<int>> halves = indices.partition(indices < limits);
+			assert(halves.first.size() == 1000);
+			assert(halves.second.size() == test_size - 1000);
+			assert(halves.first[0] == 0 && halves.first[999] == 999);
+			assert(halves.second[0] == 1000 && halves.second.back() == (int)test_size - 1);
+		}
+		
+		// test masked reductions
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> limits(test_size, 1000);
+			PV::Vector<bool> mask = indices < limits;
+			assert(indices.sum_where(mask) == 999 * 1000 / 2);
+			assert(indices.count_where(mask) == 1000);
+			assert(indices.mean_where(mask) == 499);
+			assert(indices.count_where(PV::compare_ge(indices, limits)) == test_size - 1000);
+			assert(indices.sum_where_scalar(PV::compare_lt(indices, limits)).get() == 999 * 1000 / 2);
+			PV::Vector<float> values(test_size, 2.0f);
+			assert(values.mean_where_scalar(mask).get() == 2.0f);
+			assert(values.sum_where(PV::compare_lt(indices, PV::Vector<int>(test_size, 0))) == 0.0f);
+		}
+		
+		// test aggregating several columns at once
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(1000);
+			PV::Vector<int> negated = PV::Vector<int>((size_t)1000, 0) - indices;
+			std::vector<PV::aggregate_result<int>> stats = PV::aggregate<int>({&indices, &negated});
+			assert(stats.size() == 2);
+			assert(stats[0].sum == 999 * 1000 / 2 && stats[1].sum == -999 * 1000 / 2);
+			assert(stats[0].count == 1000);
+			assert(stats[0].min == 0 && stats[0].max == 999);
+			assert(stats[1].min == -999 && stats[1].max == 0);
+			assert(stats[0].sum_of_squares == 999 * 1000 * 1999 / 6);
+			PV::Vector<bool> mask = indices < PV::Vector<int>((size_t)1000, 10);
+			stats = PV::aggregate<int>(mask, {&indices, &indices, &indices, &indices, &negated}, PV::aggregate_sum | PV::aggregate_count);
+			assert(stats.size() == 5);
+			assert(stats[4].sum == -45 && stats[4].count == 10);
+			assert(stats[4].sum_of_squares == 0);
+		}
+		
+		// test k-means clustering
+		{
+			std::vector<float> xs, ys, zs;
+			for (unsigned i = 0; i < 3000; ++i) {
+				const float offset = (float)(i % 3) * 10.0f;
+				xs.push_back(offset + (float)(i % 7) * 0.01f);
+				ys.push_back(offset - (float)(i % 5) * 0.01f);
+				zs.push_back((float)(i % 3) * -5.0f);
+			}
+			PV::Vector<float> x(xs), y(ys), z(zs);
+			PV::kmeans_result<float> clusters = PV::kmeans<float>({&x, &y, &z}, 3, 50);
+			assert(clusters.converged);
+			assert(clusters.centroids.size() == 9);
+			assert(clusters.counts[0] == 1000 && clusters.counts[1] == 1000 && clusters.counts[2] == 1000);
+			assert(clusters.assignments.size() == 3000);
+			assert(clusters.assignments[0] != clusters.assignments[1] && clusters.assignments[0] == clusters.assignments[3]);
+			for (unsigned c = 0; c < 3; ++c) {
+				const float expected = std::round(clusters.centroids[c * 3] / 10.0f) * 10.0f;
+				assert(std::fabs(clusters.centroids[c * 3] - expected) < 0.1f);
+				assert(std::fabs(clusters.centroids[c * 3 + 2] + expected / 2.0f) < 0.1f);
+			}
+		}
+		
+		// test distances and nearest neighbours
+		{
+			std::vector<float> rx, ry;
+			for (unsigned i = 0; i < 1000; ++i) {
+				rx.push_back((float)i);
+				ry.push_back(0.0f);
+			}
+			std::vector<float> qx = {10.2f, 500.0f, 998.9f}, qy = {0.0f, 3.0f, 0.0f};
+			PV::Vector<float> ref_x(rx), ref_y(ry), query_x(qx), query_y(qy);
+			PV::knn_result<float> neighbors = PV::nearest_neighbors<float>({&query_x, &query_y}, {&ref_x, &ref_y}, 3);
+			assert(neighbors.indices.size() == 9 && neighbors.distances.size() == 9);
+			assert(neighbors.indices[0] == 10 && neighbors.indices[1] == 11 && neighbors.indices[2] == 9);
+			assert(std::fabs(neighbors.distances[0] - 0.2f) < 1e-3f);
+			assert(neighbors.indices[3] == 500 && std::fabs(neighbors.distances[3] - 3.0f) < 1e-3f);
+			assert(neighbors.indices[6] == 999 && neighbors.indices[7] == 998);
+			PV::knn_result<float> manhattan = PV::nearest_neighbors<float>({&query_x, &query_y}, {&ref_x, &ref_y}, 1, PV::l1_distance);
+			assert(manhattan.indices[1] == 500 && std::fabs(manhattan.distances[1] - 3.0f) < 1e-3f);
+			PV::Vector<float> distances = PV::pairwise_distances<float>({&query_x, &query_y}, {&ref_x, &ref_y});
+			assert(distances.size() == 3000);
+			assert(std::fabs(distances[1000 + 504] - 5.0f) < 1e-3f);
+			PV::Vector<float> cosine = PV::pairwise_distances<float>({&query_x, &query_y}, {&ref_x, &ref_y}, PV::cosine_distance);
+			assert(std::fabs(cosine[5]) < 1e-3f);
+		}
+		
+		// test histograms
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<unsigned int> counts = indices.histogram(10, 0, 1000);
+			assert(counts.size() == 10);
+			assert(counts[0] == 100 && counts[8] == 100 && counts[9] == 101);
+			PV::Vector<int> keys = indices % PV::Vector<int>(test_size, 7);
+			PV::Vector<unsigned int> occurrences = keys.bincount(8);
+			assert(occurrences.size() == 8);
+			assert(occurrences[0] == (test_size + 6) / 7 && occurrences[7] == 0);
+			PV::Vector<float> values(test_size, 0.5f);
+			assert(values.histogram(4, 0.0f, 1.0f)[2] == test_size);
+			PV::Vector<int> wide(std::vector<int>{std::numeric_limits<int>::min() / 2, 0, std::numeric_limits<int>::max() / 2});
+			PV::Vector<unsigned int> wide_counts = wide.histogram(4, std::numeric_limits<int>::min() / 2, std::numeric_limits<int>::max() / 2);
+			assert(wide_counts[0] == 1 && wide_counts[2] == 1 && wide_counts[3] == 1);
+			PV::Vector<int> offset = indices % PV::Vector<int>(test_size, 11) + PV::Vector<int>(test_size, 1000000000);
+			PV::Vector<unsigned int> offset_counts = offset.histogram(11, 1000000000, 1000000010);
+			assert(offset_counts[0] == (test_size + 10) / 11 && offset_counts[10] == test_size / 11);
+		}
+		
+		// test reductions by key and over segments
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> keys = indices / PV::Vector<int>(test_size, 1000);
+			PV::Vector<int> ones(test_size, 1);
+			std::pair<PV::Vector<int>, PV::Vector<int>> sums = PV::reduce_by_key(keys, ones);
+			assert(sums.first.size() == test_size / 1000 && sums.second.size() == test_size / 1000);
+			assert(sums.first[7] == 7 && sums.second[7] == 1000);
+			std::pair<PV::Vector<int>, PV::Vector<int>> largest = PV::reduce_by_key(keys, indices, PV::aggregate_max);
+			assert(largest.second[0] == 999 && largest.second.back() == (int)test_size - 1);
+			std::pair<PV::Vector<int>, PV::Vector<int>> counts = PV::reduce_by_key(keys, indices, PV::aggregate_count);
+			assert(counts.second.sum() == (int)test_size);
+			std::vector<unsigned int> std_offsets = {0, 3, 3, 1000, 25000};
+			PV::Vector<unsigned int> offsets(std_offsets);
+			PV::Vector<int> segment_sums = PV::segmented_reduce(indices, offsets);
+			assert(segment_sums.size() == 4);
+			assert(segment_sums[0] == 3 && segment_sums[1] == 0 && segment_sums[2] == 999 * 1000 / 2 - 3);
+			PV::Vector<int> segment_mins = PV::segmented_reduce(indices, offsets, PV::aggregate_min);
+			assert(segment_mins[2] == 3 && segment_mins[3] == 1000);
+			bool past_end = false;
+			try {
+				PV::segmented_reduce(PV::Vector<int>((size_t)10, 1), offsets);
+			} catch (char const * error) {
+				past_end = true;
+			}
+			assert(past_end);
+		}
+		
+		// test grouping by key
+		{
+			PV::Vector<int> indices = PV::indices_Vector<int>(test_size);
+			PV::Vector<int> keys = indices % PV::Vector<int>(test_size, 100);
+			PV::Vector<int> ones(test_size, 1);
+			std::pair<PV::Vector<int>, PV::Vector<int>> groups = PV::group_by(keys).agg(ones, PV::aggregate_sum);
+			assert(groups.first.size() == 100 && groups.second.size() == 100);
+			assert(groups.first.sum() == 99 * 100 / 2);
+			assert(groups.second[0] == (int)test_size / 100 && groups.second[99] == (int)test_size / 100);
+			std::pair<PV::Vector<int>, PV::Vector<int>> largest = PV::group_by(keys).agg(indices, PV::aggregate_max);
+			assert(largest.second.filterBy(largest.first == PV::Vector<int>((size_t)100, 7))[0] == (int)test_size - 93);
+			std::vector<int> std_keys = {std::numeric_limits<int>::max(), 5, std::numeric_limits<int>::max()};
+			PV::Vector<int> edge_keys(std_keys), edge_values(std::vector<int>{1, 2, 3});
+			std::pair<PV::Vector<int>, PV::Vector<int>> edge = PV::group_by(edge_keys).agg(edge_values, PV::aggregate_count);
+			assert(edge.first.size() == 2 && edge.second.sum() == 3);
+			PV::Vector<short> small_keys = PV::indices_Vector<short>(1000) % PV::Vector<short>((size_t)1000, 10);
+			std::pair<PV::Vector<short>, PV::Vector<int>> sorted = PV::group_by(small_keys).agg(PV::indices_Vector<int>(1000), PV::aggregate_min);
+			assert(sorted.first.size() == 10 && sorted.first[3] == 3 && sorted.second[3] == 3);
+			PV::GroupBy<int> by_sum = PV::group_by(keys + PV::Vector<int>(test_size, 1));
+			assert(by_sum.agg(ones, PV::aggregate_count).first.size() == 100);
+			PV::Vector<short> few_keys(std::vector<short>{3, 1, 2, 1, 3});
+			std::pair<PV::Vector<short>, PV::Vector<int>> few = PV::group_by(few_keys).agg(PV::Vector<int>(std::vector<int>{1, 2, 3, 4, 5}));
+			assert(few.first.size() == 3 && few.first[0] == 1 && few.second[0] == 6 && few.second[2] == 6);
+		}
+		
 	} catch (char const * error) {
 		printf("[Error] %s\n", error);
 		exit(1);